@@ -0,0 +1,148 @@
+//
+// Copyright 2003-2006, 2022-2023, Oscar Lesta. All right reserved.
+// Distributed under the terms of the MIT License.
+//
+// Times the ways of getting at the sensors (text reads, IT87_SENSORS_READ,
+// IT87_SENSORS_REFRESH) and the conversions behind them, against a simulated
+// IT8718F whose port accesses take as long as asked for:
+//
+//	bench_read_paths [ns per port access, 1000 by default]
+//
+// Fails if a refresh takes more port accesses than its budget.
+//
+
+#include "test.h"
+
+// For the conversion helpers, which are static.
+#include "../it87_core.cpp"
+
+
+static const char* kDevice = "sensor/it87/0";
+
+
+// Runs "operation" "iterations" times, each one timed on its own, and prints
+// ns per operation (each call doing "batch" of them), tail latencies, how many
+// calls per second that would sustain, and port accesses per call.
+template<typename Operation>
+static double
+measure(const char* name, emulated_bus* bus, int32 iterations, int32 batch,
+	Operation operation)
+{
+	std::vector<int64> samples;
+	samples.reserve(iterations);
+
+	int64 portOps = bus->reads + bus->writes;
+	int64 start = host_nanotime();
+	for (int32 i = 0; i < iterations; i++) {
+		int64 before = host_nanotime();
+		operation();
+		samples.push_back(host_nanotime() - before);
+	}
+	double total = host_nanotime() - start;
+	portOps = bus->reads + bus->writes - portOps;
+
+	double perCall = total / iterations;
+	printf("%-20s %9.1f ns/op  p50 %7" B_PRId64 "  p99 %7" B_PRId64 "  p99.9 %7"
+		B_PRId64 "  max %8" B_PRId64 " ns  %11.0f calls/s  %5.1f port ops/call\n",
+		name, perCall / batch, percentile(samples, 50), percentile(samples, 99),
+		percentile(samples, 99.9), percentile(samples, 100), 1e9 / perCall,
+		(double)portOps / iterations);
+
+	return (double)portOps / iterations;
+}
+
+
+static void
+bench_conversions(emulated_bus* bus)
+{
+	// Through volatiles, so none of it gets folded away.
+	volatile int sink;
+	volatile uint8 first = 0;
+
+	measure("TwosComplement", bus, 20000, 256, [&]() {
+		for (int i = 0; i < 256; i++)
+			sink = TwosComplement((uint8)(first + i));
+	});
+	measure("CountToRPM", bus, 20000, 256, [&]() {
+		for (int i = 0; i < 256; i++)
+			sink = CountToRPM((uint8)(first + i));
+	});
+	measure("Count16ToRPM", bus, 20000, 256, [&]() {
+		for (int i = 0; i < 256; i++)
+			sink = Count16ToRPM((uint16)(first + i * 257));
+	});
+
+	char buffer[32];
+	text_output out = { buffer, sizeof(buffer), 0 };
+	measure("OutFloat", bus, 20000, 256, [&]() {
+		for (int i = 0; i < 256; i++) {
+			out.length = 0;
+			OutFloat(out, (first + i) * 16 * 168 / 100, 1000, 3, 3);
+		}
+		sink = out.length;
+	});
+}
+
+
+int
+main(int argc, char** argv)
+{
+	int64 latency = argc > 1 ? strtoll(argv[1], NULL, 0) : 1000;
+
+	emulated_bus bus;
+	emulated_bus_init(&bus);
+	emulated_chip chip;
+	setup_chip(&bus, &chip, 0x8718, 0x2E, 0x290);
+	emulated_bus_install(&bus);
+
+	// Keep the sampler out of the way: only what's measured touches the chip.
+	host_set_driver_settings("it87", "adaptive_sampling false\nsample_period 60000\n");
+	if (init_driver() != B_OK) {
+		fprintf(stderr, "no chip found\n");
+		return 2;
+	}
+
+	void* cookie = open_device(kDevice);
+	device_hooks* hooks = find_device(kDevice);
+	bus.latency = latency;
+
+	printf("bench_read_paths: IT8718F, %" B_PRId64 " ns per port access\n", latency);
+
+	char text[1024];
+	measure("device_read", &bus, 100000, 1, [&]() {
+		size_t length = sizeof(text);
+		hooks->read(cookie, 0, text, &length);
+	});
+
+	it87_sensors_data data;
+	measure("IT87_SENSORS_READ", &bus, 100000, 1, [&]() {
+		control_device(kDevice, cookie, IT87_SENSORS_READ, &data, sizeof(data));
+	});
+
+	control_device(kDevice, cookie, IT87_SENSORS_RESET_STATS, NULL, 0);
+	it87_sensors_sample sample;
+	double refreshOps = measure("IT87_SENSORS_REFRESH", &bus,
+		latency > 10000 ? 200 : 2000, 1, [&]() {
+		control_device(kDevice, cookie, IT87_SENSORS_REFRESH, &sample, sizeof(sample));
+	});
+
+	bench_conversions(&bus);
+
+	// The driver's own count has to agree with the bus'.
+	it87_sensors_stats stats;
+	control_device(kDevice, cookie, IT87_SENSORS_GET_STATS, &stats, sizeof(stats));
+	printf("port ops per sample: %.1f (driver: %" B_PRId64 ", budget %" B_PRId64
+		", %" B_PRId64 " over budget)\n", refreshOps, stats.refresh_port_ops,
+		stats.refresh_port_budget, stats.over_budget_refreshes);
+
+	CHECK(refreshOps <= stats.refresh_port_budget);
+	CHECK_EQUAL(stats.refresh_port_ops, stats.refresh_port_budget);
+	CHECK_EQUAL(stats.over_budget_refreshes, 0);
+
+	bus.latency = 0;
+	close_device(kDevice, cookie);
+	uninit_driver();
+	emulated_bus_install(NULL);
+
+	return test_result("bench_read_paths");
+}
@@ -0,0 +1,123 @@
+//
+// Copyright 2003-2006, 2022-2023, Oscar Lesta. All right reserved.
+// Distributed under the terms of the MIT License.
+//
+// The refresh routines specialized per chip (chip->info->refresh) against the table
+// driven one (it87_refresh_channels()), for each set of chip traits. Once on
+// a bus that answers right away, so only the driver's own work gets timed,
+// and once on a simulated one whose port accesses take as long as asked for:
+//
+//	bench_refresh [ns per port access, 1000 by default]
+//
+
+#include "test.h"
+
+#include "../it87_core.h"
+
+
+static const uint16 kChipIDs[] = { 0x8705, 0x8718, 0x8721, 0x8771, 0x8625 };
+
+
+// Answers anything, at no cost.
+static uint8
+null_read_io_8(int port)
+{
+	return 0x40;
+}
+
+
+static void
+null_write_io_8(int port, uint8 value)
+{
+}
+
+
+static isa_module_info sNullISA = {
+	{ B_ISA_MODULE_NAME, 0, NULL },
+	null_read_io_8,
+	null_write_io_8,
+};
+
+
+template<typename Refresh>
+static double
+time_refresh(int32 iterations, std::vector<int64>& samples, Refresh refresh)
+{
+	samples.clear();
+	int64 start = host_nanotime();
+	for (int32 i = 0; i < iterations; i++) {
+		int64 before = host_nanotime();
+		refresh();
+		samples.push_back(host_nanotime() - before);
+	}
+	return (double)(host_nanotime() - start) / iterations;
+}
+
+
+static void
+compare(it87_chip* chip, const char* bus, int32 iterations)
+{
+	it87_sensors_data specialized = {}, generic = {};
+	it87_sensors_raw specializedRaw = {}, genericRaw = {};
+	std::vector<int64> samples;
+	samples.reserve(iterations);
+
+	double specializedTime = time_refresh(iterations, samples, [&]() {
+		chip->info->refresh(chip, specialized, specializedRaw);
+	});
+	int64 specializedP99 = percentile(samples, 99);
+
+	double genericTime = time_refresh(iterations, samples, [&]() {
+		it87_refresh_channels(chip, generic, genericRaw, chip->available_channels);
+	});
+	int64 genericP99 = percentile(samples, 99);
+
+	printf("IT%04x, %-9s specialized %9.1f ns (p99 %7" B_PRId64 "), generic %9.1f ns"
+		" (p99 %7" B_PRId64 "): %.2fx\n", chip->chip_id, bus, specializedTime,
+		specializedP99, genericTime, genericP99, genericTime / specializedTime);
+
+	// Both have to read the same.
+	CHECK(memcmp(&specialized, &generic, sizeof(it87_sensors_data)) == 0);
+	CHECK(memcmp(&specializedRaw, &genericRaw, sizeof(it87_sensors_raw)) == 0);
+}
+
+
+int
+main(int argc, char** argv)
+{
+	int64 latency = argc > 1 ? strtoll(argv[1], NULL, 0) : 1000;
+	printf("bench_refresh: %" B_PRId64 " ns per port access\n", latency);
+
+	for (size_t i = 0; i < sizeof(kChipIDs) / sizeof(kChipIDs[0]); i++) {
+		emulated_bus bus;
+		emulated_bus_init(&bus);
+		emulated_chip emulated;
+		setup_chip(&bus, &emulated, kChipIDs[i], 0x2E, 0x290);
+		emulated_bus_install(&bus);
+
+		if (get_module(B_ISA_MODULE_NAME, (module_info**)&gISA) != B_OK) {
+			fprintf(stderr, "no ISA bus\n");
+			return 2;
+		}
+
+		it87_chip chip;
+		memset(&chip, 0, sizeof(chip));
+		chip.config_port = 0x2E;
+		CHECK_EQUAL(it87_probe(&chip), B_OK);
+		it87_config(&chip, true);
+
+		isa_module_info* emulatedISA = gISA;
+		gISA = &sNullISA;
+		compare(&chip, "no bus,", 1000000);
+		gISA = emulatedISA;
+
+		bus.latency = latency;
+		compare(&chip, "emulated,", latency > 10000 ? 200 : 2000);
+
+		put_module(B_ISA_MODULE_NAME);
+		gISA = NULL;
+		emulated_bus_install(NULL);
+	}
+
+	return test_result("bench_refresh");
+}
@@ -0,0 +1,80 @@
+//
+// Stand-in for Haiku's <Drivers.h>, for building the driver on the host.
+// Only what the it87 sources use. See host/kernel.cpp.
+//
+
+#ifndef _HOST_DRIVERS_H
+#define _HOST_DRIVERS_H
+
+#include <OS.h>
+#include <module.h>
+
+#include <fcntl.h>
+#include <sys/uio.h>
+
+typedef struct selectsync selectsync;
+
+typedef status_t (*device_open_hook)(const char* name, uint32 flags, void** cookie);
+typedef status_t (*device_close_hook)(void* cookie);
+typedef status_t (*device_free_hook)(void* cookie);
+typedef status_t (*device_control_hook)(void* cookie, uint32 op, void* data,
+	size_t len);
+typedef status_t (*device_read_hook)(void* cookie, off_t position, void* data,
+	size_t* numBytes);
+typedef status_t (*device_write_hook)(void* cookie, off_t position,
+	const void* data, size_t* numBytes);
+typedef status_t (*device_select_hook)(void* cookie, uint8 event, uint32 ref,
+	selectsync* sync);
+typedef status_t (*device_deselect_hook)(void* cookie, uint8 event,
+	selectsync* sync);
+typedef status_t (*device_read_pages_hook)(void* cookie, off_t position,
+	const iovec* vec, size_t count, size_t* _numBytes);
+typedef status_t (*device_write_pages_hook)(void* cookie, off_t position,
+	const iovec* vec, size_t count, size_t* _numBytes);
+
+typedef struct {
+	device_open_hook		open;
+	device_close_hook		close;
+	device_free_hook		free;
+	device_control_hook		control;
+	device_read_hook		read;
+	device_write_hook		write;
+	device_select_hook		select;
+	device_deselect_hook	deselect;
+	device_read_pages_hook	read_pages;
+	device_write_pages_hook	write_pages;
+} device_hooks;
+
+#define B_CUR_DRIVER_API_VERSION	2
+
+enum {
+	B_GET_DEVICE_SIZE = 1,
+	B_DEVICE_OP_CODES_END = 9999
+};
+
+enum {
+	B_SELECT_READ = 1,
+	B_SELECT_WRITE,
+	B_SELECT_ERROR,
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+status_t		notify_select_event(selectsync* sync, uint8 event);
+
+// What a driver exports.
+status_t		init_hardware(void);
+const char**	publish_devices(void);
+device_hooks*	find_device(const char* name);
+status_t		init_driver(void);
+void			uninit_driver(void);
+
+extern int32	api_version;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	// _HOST_DRIVERS_H
@@ -0,0 +1,38 @@
+//
+// Stand-in for Haiku's <Errors.h>, for building the driver on the host.
+// Same layout of error bases; only the codes the it87 sources use.
+//
+
+#ifndef _HOST_ERRORS_H
+#define _HOST_ERRORS_H
+
+#include <errno.h>
+#include <limits.h>
+
+#define B_GENERAL_ERROR_BASE	INT_MIN
+#define B_OS_ERROR_BASE			(B_GENERAL_ERROR_BASE + 0x1000)
+#define B_STORAGE_ERROR_BASE	(B_GENERAL_ERROR_BASE + 0x6000)
+#define B_DEVICE_ERROR_BASE		(B_GENERAL_ERROR_BASE + 0xa000)
+
+#define B_NO_MEMORY				(B_GENERAL_ERROR_BASE + 0)
+#define B_BAD_INDEX				(B_GENERAL_ERROR_BASE + 3)
+#define B_BAD_VALUE				(B_GENERAL_ERROR_BASE + 5)
+#define B_NAME_NOT_FOUND		(B_GENERAL_ERROR_BASE + 7)
+#define B_TIMED_OUT				(B_GENERAL_ERROR_BASE + 9)
+#define B_WOULD_BLOCK			(B_GENERAL_ERROR_BASE + 11)
+#define B_BUSY					(B_GENERAL_ERROR_BASE + 14)
+#define B_NOT_ALLOWED			(B_GENERAL_ERROR_BASE + 15)
+
+#define B_ERROR					(-1)
+
+#define B_BAD_SEM_ID			(B_OS_ERROR_BASE + 0)
+#define B_NO_MORE_SEMS			(B_OS_ERROR_BASE + 1)
+#define B_BAD_THREAD_ID			(B_OS_ERROR_BASE + 0x100)
+#define B_BAD_ADDRESS			(B_OS_ERROR_BASE + 0x301)
+
+#define B_ENTRY_NOT_FOUND		(B_STORAGE_ERROR_BASE + 3)
+
+#define B_DEV_INVALID_IOCTL		(B_DEVICE_ERROR_BASE + 0)
+#define B_DEVICE_NOT_FOUND		(B_DEVICE_ERROR_BASE + 12)
+
+#endif	// _HOST_ERRORS_H
@@ -0,0 +1,20 @@
+//
+// Stand-in for Haiku's <ISA.h>, for building the driver on the host. The host
+// side bus goes in with host_set_isa_module(), see host/host.h.
+//
+
+#ifndef _HOST_ISA_H
+#define _HOST_ISA_H
+
+#include <module.h>
+
+#define B_ISA_MODULE_NAME	"bus_managers/isa/v1"
+
+typedef struct isa_module_info {
+	module_info	binfo;
+
+	uint8		(*read_io_8)(int mapped_io_addr);
+	void		(*write_io_8)(int mapped_io_addr, uint8 value);
+} isa_module_info;
+
+#endif	// _HOST_ISA_H
@@ -0,0 +1,31 @@
+//
+// Stand-in for Haiku's <KernelExport.h>, for building the driver on the host.
+// Only what the it87 sources use. See host/kernel.cpp.
+//
+
+#ifndef _HOST_KERNEL_EXPORT_H
+#define _HOST_KERNEL_EXPORT_H
+
+#include <OS.h>
+
+// The C library has a dprintf() of its own, with another signature. Get its
+// declaration out of the way before renaming ours.
+#include <stdio.h>
+#define dprintf		host_dprintf
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+thread_id	spawn_kernel_thread(thread_func function, const char* name,
+				int32 priority, void* data);
+
+void		dprintf(const char* format, ...) __attribute__((format(printf, 1, 2)));
+void		spin(bigtime_t microseconds);
+status_t	user_memcpy(void* to, const void* from, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	// _HOST_KERNEL_EXPORT_H
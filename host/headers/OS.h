@@ -0,0 +1,83 @@
+//
+// Stand-in for Haiku's <OS.h>, for building the driver on the host.
+// Only what the it87 sources use. See host/kernel.cpp.
+//
+
+#ifndef _HOST_OS_H
+#define _HOST_OS_H
+
+#include <Errors.h>
+#include <SupportDefs.h>
+
+#define B_OS_NAME_LENGTH		32
+#define B_PAGE_SIZE				4096
+#define B_INFINITE_TIMEOUT		(9223372036854775807LL)
+
+typedef int32	area_id;
+typedef int32	sem_id;
+typedef int32	thread_id;
+
+// Areas
+#define B_ANY_ADDRESS			0
+#define B_ANY_KERNEL_ADDRESS	4
+
+#define B_NO_LOCK				0
+#define B_FULL_LOCK				2
+
+#define B_READ_AREA				(1 << 0)
+#define B_WRITE_AREA			(1 << 1)
+#define B_KERNEL_READ_AREA		(1 << 4)
+#define B_KERNEL_WRITE_AREA		(1 << 5)
+#define B_CLONEABLE_AREA		(1 << 8)
+
+// Semaphores, and timeouts in general
+enum {
+	B_CAN_INTERRUPT			= 0x01,
+	B_CHECK_PERMISSION		= 0x04,
+	B_KILL_CAN_INTERRUPT	= 0x20,
+	B_DO_NOT_RESCHEDULE		= 0x02,
+	B_RELEASE_ALL			= 0x08,
+	B_RELATIVE_TIMEOUT		= 0x08,
+	B_ABSOLUTE_TIMEOUT		= 0x10,
+};
+
+// Threads
+#define B_LOW_PRIORITY			5
+#define B_NORMAL_PRIORITY		10
+
+typedef status_t (*thread_func)(void* data);
+
+#define B_SYSTEM_TIMEBASE		0
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+area_id		create_area(const char* name, void** startAddress, uint32 addressSpec,
+				size_t size, uint32 lock, uint32 protection);
+area_id		clone_area(const char* name, void** destAddress, uint32 addressSpec,
+				uint32 protection, area_id source);
+status_t	delete_area(area_id area);
+
+sem_id		create_sem(int32 count, const char* name);
+status_t	delete_sem(sem_id id);
+status_t	acquire_sem(sem_id id);
+status_t	acquire_sem_etc(sem_id id, int32 count, uint32 flags, bigtime_t timeout);
+status_t	release_sem(sem_id id);
+status_t	release_sem_etc(sem_id id, int32 count, uint32 flags);
+status_t	switch_sem(sem_id semToBeReleased, sem_id id);
+status_t	switch_sem_etc(sem_id semToBeReleased, sem_id id, int32 count, uint32 flags,
+				bigtime_t timeout);
+
+status_t	resume_thread(thread_id thread);
+status_t	wait_for_thread(thread_id thread, status_t* returnValue);
+status_t	snooze(bigtime_t amount);
+status_t	snooze_until(bigtime_t time, int timeBase);
+
+bigtime_t	system_time(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	// _HOST_OS_H
@@ -0,0 +1,64 @@
+//
+// Stand-in for Haiku's <SupportDefs.h>, for building the driver on the host.
+// Only what the it87 sources use. See host/kernel.cpp.
+//
+
+#ifndef _HOST_SUPPORT_DEFS_H
+#define _HOST_SUPPORT_DEFS_H
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+typedef int8_t				int8;
+typedef uint8_t				uint8;
+typedef int16_t				int16;
+typedef uint16_t			uint16;
+typedef int32_t				int32;
+typedef uint32_t			uint32;
+typedef int64_t				int64;
+typedef uint64_t			uint64;
+
+typedef volatile int32		vint32;
+typedef volatile int64		vint64;
+
+typedef int32				status_t;
+typedef int64				bigtime_t;
+typedef uint32				type_code;
+typedef unsigned long		addr_t;
+
+#define B_PRId32			PRId32
+#define B_PRIu32			PRIu32
+#define B_PRId64			PRId64
+
+#define B_OK				((status_t)0)
+
+#define min_c(a, b)			((a) > (b) ? (b) : (a))
+#define max_c(a, b)			((a) > (b) ? (a) : (b))
+
+#define B_COUNT_OF(a)		(sizeof(a) / sizeof(a[0]))
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void	atomic_set(int32* value, int32 newValue);
+int32	atomic_get_and_set(int32* value, int32 newValue);
+int32	atomic_test_and_set(int32* value, int32 newValue, int32 testAgainst);
+int32	atomic_add(int32* value, int32 addValue);
+int32	atomic_and(int32* value, int32 andValue);
+int32	atomic_or(int32* value, int32 orValue);
+int32	atomic_get(int32* value);
+
+void	atomic_set64(int64* value, int64 newValue);
+int64	atomic_get_and_set64(int64* value, int64 newValue);
+int64	atomic_test_and_set64(int64* value, int64 newValue, int64 testAgainst);
+int64	atomic_add64(int64* value, int64 addValue);
+int64	atomic_get64(int64* value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	// _HOST_SUPPORT_DEFS_H
@@ -0,0 +1,41 @@
+//
+// Stand-in for Haiku's <driver_settings.h>, for building the driver on the
+// host. Settings files are set up with host_set_driver_settings(), see
+// host/host.h.
+//
+
+#ifndef _HOST_DRIVER_SETTINGS_H
+#define _HOST_DRIVER_SETTINGS_H
+
+#include <SupportDefs.h>
+
+typedef struct driver_parameter {
+	char*						name;
+	int							value_count;
+	char**						values;
+	int							parameter_count;
+	struct driver_parameter*	parameters;
+} driver_parameter;
+
+typedef struct driver_settings {
+	int							parameter_count;
+	struct driver_parameter*	parameters;
+} driver_settings;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void*					load_driver_settings(const char* driverName);
+status_t				unload_driver_settings(void* handle);
+const char*				get_driver_parameter(void* handle, const char* key,
+							const char* unknownValue, const char* noArgValue);
+bool					get_driver_boolean_parameter(void* handle, const char* key,
+							bool unknownValue, bool noArgValue);
+const driver_settings*	get_driver_settings(void* handle);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	// _HOST_DRIVER_SETTINGS_H
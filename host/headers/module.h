@@ -0,0 +1,35 @@
+//
+// Stand-in for Haiku's <module.h>, for building the driver on the host.
+// Only what the it87 sources use. See host/kernel.cpp.
+//
+
+#ifndef _HOST_MODULE_H
+#define _HOST_MODULE_H
+
+#include <OS.h>
+
+typedef struct module_info {
+	const char*	name;
+	uint32		flags;
+	status_t	(*std_ops)(int32 op, ...);
+} module_info;
+
+#define B_MODULE_INIT		1
+#define B_MODULE_UNINIT		2
+#define B_KEEP_LOADED		0x00000001
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+status_t	get_module(const char* path, module_info** _info);
+status_t	put_module(const char* path);
+
+// What a module (or a driver publishing modules) exports.
+extern module_info*	modules[];
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	// _HOST_MODULE_H
@@ -0,0 +1,39 @@
+//
+// Copyright 2003-2006, 2022-2023, Oscar Lesta. All right reserved.
+// Distributed under the terms of the MIT License.
+//
+// Host side of the kernel stand-ins in host/kernel.cpp: what tests and
+// benchmarks use to set up the world the driver runs in.
+//
+
+#ifndef _HOST_H_
+#define _HOST_H_
+
+#include <Drivers.h>
+#include <ISA.h>
+
+// What notify_select_event() gets passed. Counts the events signalled.
+struct selectsync {
+	int32	events;
+};
+
+// get_module(B_ISA_MODULE_NAME) hands out this one from now on. NULL makes it
+// fail, like on a machine without an ISA bus.
+void		host_set_isa_module(isa_module_info* module);
+
+// Contents of the settings file load_driver_settings("name") finds, in the
+// usual driver_settings syntax. NULL removes it.
+void		host_set_driver_settings(const char* name, const char* text);
+
+// dprintf() goes to stderr if set, and nowhere otherwise. Off by default, or
+// set by the IT87_HOST_DEBUG environment variable.
+void		host_set_debug_output(bool enabled);
+
+// Nanoseconds from a monotonic clock, for benchmarks.
+int64		host_nanotime(void);
+
+// Busy-waits "nanoseconds", like a slow port access does, yielding to other
+// threads while at it.
+void		host_delay(int64 nanoseconds);
+
+#endif	// _HOST_H_
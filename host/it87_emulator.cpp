@@ -0,0 +1,420 @@
+//
+// Copyright 2003-2006, 2022-2023, Oscar Lesta. All right reserved.
+// Distributed under the terms of the MIT License.
+//
+// See it87_emulator.h. Register numbers and bits are the ones in it87_regs.h,
+// and the same datasheets the driver was written from.
+//
+
+#include "it87_emulator.h"
+
+#include <string.h>
+
+#include "../it87_regs.h"
+#include "host.h"
+
+
+// What tells the chips apart, as far as the EC goes.
+struct chip_model {
+	uint16	id;
+	uint8	fan_count;
+	bool	fans_16bit;
+};
+
+static const chip_model kModels[] = {
+	{ 0x8705, 3, false },
+	{ 0x8712, 3, false },
+	{ 0x8718, 5, true },
+	{ 0x8720, 5, true },
+	{ 0x8721, 5, true },
+	{ 0x8726, 5, true },
+	{ 0x8728, 5, true },
+	{ 0x8625, 5, true },
+	{ 0x8628, 5, true },
+	{ 0x8655, 5, true },
+	{ 0x8771, 3, true },
+	{ 0x8772, 3, true },
+};
+
+// Tachometer count registers: LSB, MSB.
+static const uint8 kFanRegisters[5][2] = {
+	{ IT87_REG_FAN_1, IT87_REG_FAN_1_EXT },
+	{ IT87_REG_FAN_2, IT87_REG_FAN_2_EXT },
+	{ IT87_REG_FAN_3, IT87_REG_FAN_3_EXT },
+	{ IT87_REG_FAN_4_LSB, IT87_REG_FAN_4_MSB },
+	{ IT87_REG_FAN_5_LSB, IT87_REG_FAN_5_MSB },
+};
+
+// Fan limit registers: LSB, MSB.
+static const uint8 kFanLimitRegisters[5][2] = {
+	{ IT87_REG_FAN_LIMIT1, IT87_REG_FAN_LIMIT1_EXT },
+	{ IT87_REG_FAN_LIMIT2, IT87_REG_FAN_LIMIT2_EXT },
+	{ IT87_REG_FAN_LIMIT3, IT87_REG_FAN_LIMIT3_EXT },
+	{ IT87_REG_FAN_4_LIMIT_LSB, IT87_REG_FAN_4_LIMIT_MSB },
+	{ IT87_REG_FAN_5_LIMIT_LSB, IT87_REG_FAN_5_LIMIT_MSB },
+};
+
+// Bits in INT_STATUS3:INT_STATUS2:INT_STATUS1 for each fan.
+static const uint8 kFanAlarmBits[5] = { 0, 1, 2, 3, 6 };
+
+static emulated_bus* sInstalledBus;
+
+
+//-----------------------------------------------------------------------------
+//	#pragma mark - Chip
+
+void
+emulated_chip_init(emulated_chip* chip, uint16 chipID, uint16 configPort,
+	uint16 baseAddress)
+{
+	memset(chip, 0, sizeof(emulated_chip));
+	chip->config_port = configPort;
+	chip->chip_id = chipID;
+	chip->fan_count = 3;
+	chip->base_address = baseAddress;
+
+	for (size_t i = 0; i < sizeof(kModels) / sizeof(kModels[0]); i++) {
+		if (kModels[i].id == chipID) {
+			chip->fan_count = kModels[i].fan_count;
+			chip->fans_16bit = kModels[i].fans_16bit;
+		}
+	}
+
+	// Power-on defaults: monitoring stopped, and limits nothing can trip.
+	uint8* ec = chip->ec;
+	ec[IT87_REG_CONFIG] = 0x18;
+	ec[IT87_REG_FAN_DIV] = IT87_FANDIV;
+	ec[IT87_REG_ITE_VENDOR_ID] = 0x90;
+	for (int i = 0; i < 8; i++) {
+		ec[IT87_REG_LIM_VIN0_HI + i * 2] = 0xff;
+		ec[IT87_REG_LIM_VIN0_LOW + i * 2] = 0x00;
+	}
+	for (int i = 0; i < 3; i++) {
+		ec[IT87_REG_LIM_TEMP0_HI + i * 2] = 0x7f;
+		ec[IT87_REG_LIM_TEMP0_LOW + i * 2] = 0x80;
+	}
+	for (int fan = 0; fan < 5; fan++) {
+		ec[kFanLimitRegisters[fan][0]] = 0xff;
+		if (chip->fans_16bit)
+			ec[kFanLimitRegisters[fan][1]] = 0xff;
+	}
+
+	// Stopped fans read as the maximum count.
+	for (int fan = 0; fan < 5; fan++)
+		emulated_chip_set_fan(chip, fan, 0xffff);
+}
+
+
+void
+emulated_chip_set_fan(emulated_chip* chip, int fan, uint16 count)
+{
+	chip->inputs[kFanRegisters[fan][0]] = count & 0xff;
+	if (chip->fans_16bit)
+		chip->inputs[kFanRegisters[fan][1]] = count >> 8;
+}
+
+
+static inline bool
+is_monitoring(emulated_chip* chip)
+{
+	return (chip->ec[IT87_REG_CONFIG] & (1 << 0)) != 0;
+}
+
+
+static inline bool
+fan_is_16bit(emulated_chip* chip, int fan)
+{
+	// Fans 1 to 3 need their bit in FAN_16BITS set, the others always are.
+	return chip->fans_16bit
+		&& (fan >= 3 || (chip->ec[IT87_REG_FAN_16BITS] & (1 << fan)) != 0);
+}
+
+
+// Latches the inputs into the value registers, and flags what's out of limits.
+static void
+convert(emulated_chip* chip)
+{
+	uint8* ec = chip->ec;
+	uint32 status = 0;
+
+	for (int i = 0; i < 8; i++) {
+		uint8 value = ec[IT87_REG_VIN0 + i] = chip->inputs[IT87_REG_VIN0 + i];
+		if (value > ec[IT87_REG_LIM_VIN0_HI + i * 2] || value < ec[IT87_REG_LIM_VIN0_LOW + i * 2])
+			status |= 1 << (8 + i);
+	}
+	ec[IT87_REG_VBAT] = chip->inputs[IT87_REG_VBAT];
+
+	for (int i = 0; i < 3; i++) {
+		int8 value = ec[IT87_REG_TEMP0 + i] = chip->inputs[IT87_REG_TEMP0 + i];
+		if (value > (int8)ec[IT87_REG_LIM_TEMP0_HI + i * 2]
+			|| value < (int8)ec[IT87_REG_LIM_TEMP0_LOW + i * 2])
+			status |= 1 << (16 + i);
+	}
+
+	for (int fan = 0; fan < chip->fan_count; fan++) {
+		uint8 lsb = kFanRegisters[fan][0];
+		uint8 msb = kFanRegisters[fan][1];
+		uint16 count = ec[lsb] = chip->inputs[lsb];
+		uint16 limit = ec[kFanLimitRegisters[fan][0]];
+		if (fan_is_16bit(chip, fan)) {
+			ec[msb] = chip->inputs[msb];
+			count |= ec[msb] << 8;
+			limit |= ec[kFanLimitRegisters[fan][1]] << 8;
+		} else if (chip->fans_16bit)
+			ec[msb] = 0;
+
+		// Fans trip when too slow, that is, when the count goes above the limit.
+		if (count > limit)
+			status |= 1 << kFanAlarmBits[fan];
+	}
+
+	// Sticky until read.
+	ec[IT87_REG_INT_STATUS1] |= status & 0xff;
+	ec[IT87_REG_INT_STATUS2] |= (status >> 8) & 0xff;
+	ec[IT87_REG_INT_STATUS3] |= (status >> 16) & 0xff;
+
+	chip->conversions++;
+}
+
+
+static uint8
+read_ec(emulated_chip* chip, uint8 reg)
+{
+	if (is_monitoring(chip)) {
+		bigtime_t now = system_time();
+		if (now - chip->last_conversion >= chip->conversion_time) {
+			convert(chip);
+			chip->last_conversion = now;
+		}
+	}
+
+	uint8 value = chip->ec[reg];
+	if (reg >= IT87_REG_INT_STATUS1 && reg <= IT87_REG_INT_STATUS3)
+		chip->ec[reg] = 0;	// cleared by reading.
+	return value;
+}
+
+
+static void
+write_ec(emulated_chip* chip, uint8 reg, uint8 value)
+{
+	if (reg == IT87_REG_CONFIG && !is_monitoring(chip) && (value & (1 << 0)) != 0) {
+		// Starting: the first conversion takes a full cycle from now.
+		chip->last_conversion = system_time();
+	}
+
+	chip->ec[reg] = value;
+}
+
+
+static uint8
+read_config(emulated_chip* chip, uint8 reg)
+{
+	switch (reg) {
+		case IT87_LDN:
+			return chip->ldn;
+		case IT87_CHIP_ID_1:
+			return chip->chip_id >> 8;
+		case IT87_CHIP_ID_1 + 1:
+			return chip->chip_id & 0xff;
+		case IT87_CONFIG_SELECT_CHIP_VER:
+			return 0x01;
+	}
+
+	// Only the EC logical device is modelled.
+	if (chip->ldn != 4)
+		return 0x00;
+
+	switch (reg) {
+		case 0x30:
+			return chip->ec_active ? 1 : 0;
+		case 0x60:
+			return chip->base_address >> 8;
+		case 0x61:
+			return chip->base_address & 0xff;
+	}
+	return 0x00;
+}
+
+
+static void
+write_config(emulated_chip* chip, uint8 reg, uint8 value)
+{
+	switch (reg) {
+		case IT87_CONFIG_CTRL:
+			if ((value & (1 << 1)) != 0)
+				chip->key_state = 0;	// back to "Wait for Key".
+			return;
+		case IT87_LDN:
+			chip->ldn = value;
+			return;
+	}
+
+	if (chip->ldn != 4)
+		return;
+
+	switch (reg) {
+		case 0x30:
+			chip->ec_active = (value & 1) != 0;
+			break;
+		case 0x60:
+			chip->base_address = (chip->base_address & 0x00ff) | value << 8;
+			break;
+		case 0x61:
+			chip->base_address = (chip->base_address & 0xff00) | value;
+			break;
+	}
+}
+
+
+// MB PnP mode is entered by writing 0x87, 0x01, 0x55 and 0x55 to the config
+// port (0xAA as the last one, for chips at 0x4E).
+static void
+feed_key(emulated_chip* chip, uint8 value)
+{
+	const uint8 key[4] = { 0x87, 0x01, 0x55,
+		(uint8)(chip->config_port == 0x4E ? 0xAA : 0x55) };
+
+	if (value == key[chip->key_state])
+		chip->key_state++;
+	else
+		chip->key_state = value == key[0] ? 1 : 0;
+}
+
+
+static bool
+chip_read(emulated_chip* chip, uint16 port, uint8& value)
+{
+	bool configMode = chip->key_state == 4;
+
+	if (port == chip->config_port) {
+		value = configMode ? chip->config_index : 0xff;
+		return true;
+	}
+	if (port == chip->config_port + 1) {
+		value = configMode ? read_config(chip, chip->config_index) : 0xff;
+		return true;
+	}
+
+	if (!chip->ec_active || chip->base_address == 0)
+		return false;
+
+	if (port == chip->base_address + IT87_ADDR_PORT_OFFSET) {
+		value = chip->ec_index;	// never busy.
+		return true;
+	}
+	if (port == chip->base_address + IT87_DATA_PORT_OFFSET) {
+		value = read_ec(chip, chip->ec_index);
+		return true;
+	}
+	return false;
+}
+
+
+static bool
+chip_write(emulated_chip* chip, uint16 port, uint8 value)
+{
+	if (port == chip->config_port) {
+		if (chip->key_state == 4)
+			chip->config_index = value;
+		else
+			feed_key(chip, value);
+		return true;
+	}
+	if (port == chip->config_port + 1) {
+		if (chip->key_state == 4)
+			write_config(chip, chip->config_index, value);
+		return true;
+	}
+
+	if (!chip->ec_active || chip->base_address == 0)
+		return false;
+
+	if (port == chip->base_address + IT87_ADDR_PORT_OFFSET) {
+		if (chip->select_hook != NULL)
+			chip->select_hook(chip, value, chip->select_cookie);
+		chip->ec_index = value;
+		return true;
+	}
+	if (port == chip->base_address + IT87_DATA_PORT_OFFSET) {
+		write_ec(chip, chip->ec_index, value);
+		return true;
+	}
+	return false;
+}
+
+
+//-----------------------------------------------------------------------------
+//	#pragma mark - Bus
+
+void
+emulated_bus_init(emulated_bus* bus)
+{
+	memset(bus, 0, sizeof(emulated_bus));
+}
+
+
+void
+emulated_bus_add_chip(emulated_bus* bus, emulated_chip* chip)
+{
+	if (bus->chip_count < EMULATED_MAX_CHIPS)
+		bus->chips[bus->chip_count++] = chip;
+}
+
+
+// Nothing answering reads as all ones, like on a real bus.
+uint8
+emulated_bus_read(emulated_bus* bus, uint16 port)
+{
+	atomic_add64(&bus->reads, 1);
+	host_delay(bus->latency);
+
+	uint8 value = 0xff;
+	for (int32 i = 0; i < bus->chip_count; i++) {
+		if (chip_read(bus->chips[i], port, value))
+			break;
+	}
+	return value;
+}
+
+
+void
+emulated_bus_write(emulated_bus* bus, uint16 port, uint8 value)
+{
+	atomic_add64(&bus->writes, 1);
+	host_delay(bus->latency);
+
+	for (int32 i = 0; i < bus->chip_count; i++) {
+		if (chip_write(bus->chips[i], port, value))
+			break;
+	}
+}
+
+
+static uint8
+isa_read_io_8(int port)
+{
+	return emulated_bus_read(sInstalledBus, port);
+}
+
+
+static void
+isa_write_io_8(int port, uint8 value)
+{
+	emulated_bus_write(sInstalledBus, port, value);
+}
+
+
+static isa_module_info sISAModule = {
+	{ B_ISA_MODULE_NAME, 0, NULL },
+	isa_read_io_8,
+	isa_write_io_8,
+};
+
+
+void
+emulated_bus_install(emulated_bus* bus)
+{
+	sInstalledBus = bus;
+	host_set_isa_module(bus != NULL ? &sISAModule : NULL);
+}
@@ -0,0 +1,79 @@
+//
+// Copyright 2003-2006, 2022-2023, Oscar Lesta. All right reserved.
+// Distributed under the terms of the MIT License.
+//
+// A simulated ISA bus with IT87xx chips on it, for running the driver on the
+// host. Each chip answers on its Super I/O config ports once it gets the MB PnP
+// key, exposes the EC (logical device 4) at the base address programmed there,
+// and keeps an EC register bank laid out as on the real thing.
+//
+
+#ifndef _IT87_EMULATOR_H_
+#define _IT87_EMULATOR_H_
+
+#include <ISA.h>
+#include <OS.h>
+
+#define EMULATED_MAX_CHIPS	4
+
+struct emulated_chip;
+
+// Called when a register number gets written to the EC index port, before the
+// chip does anything with it. Tests use it to change the inputs at a well known
+// point of a refresh.
+typedef void (*emulated_select_hook)(emulated_chip* chip, uint8 reg, void* cookie);
+
+struct emulated_chip {
+	// Set up by emulated_chip_init() from the chip ID, change before use.
+	uint16		config_port;		// 0x2E or 0x4E, which also picks the key.
+	uint16		chip_id;
+	uint8		fan_count;
+	bool		fans_16bit;
+	uint16		base_address;		// of the EC, as LDN 4 reports it.
+	bool		ec_active;			// LDN 4 activation bit (0x30).
+	bigtime_t	conversion_time;	// µs for the ADC to scan all inputs, 0 for
+									// values that follow the inputs right away.
+
+	// What the value registers latch on each conversion, indexed by register
+	// (see emulated_chip_set_fan()). Only latched while monitoring is on.
+	uint8		inputs[256];
+
+	// The EC register bank.
+	uint8		ec[256];
+
+	emulated_select_hook select_hook;
+	void*		select_cookie;
+
+	// Port interface state.
+	int32		key_state;			// key bytes matched so far, 4 once in MB PnP mode.
+	uint8		config_index;
+	uint8		ldn;
+	uint8		ec_index;
+	bigtime_t	last_conversion;
+	int64		conversions;
+};
+
+struct emulated_bus {
+	emulated_chip*	chips[EMULATED_MAX_CHIPS];
+	int32			chip_count;
+	int64			latency;		// ns each port access takes, as on a real LPC bus.
+
+	int64			reads;			// port accesses seen, of any kind.
+	int64			writes;
+};
+
+
+void		emulated_chip_init(emulated_chip* chip, uint16 chipID, uint16 configPort,
+				uint16 baseAddress);
+void		emulated_chip_set_fan(emulated_chip* chip, int fan, uint16 count);
+
+void		emulated_bus_init(emulated_bus* bus);
+void		emulated_bus_add_chip(emulated_bus* bus, emulated_chip* chip);
+
+// Makes "bus" the one get_module(B_ISA_MODULE_NAME) hands out.
+void		emulated_bus_install(emulated_bus* bus);
+
+uint8		emulated_bus_read(emulated_bus* bus, uint16 port);
+void		emulated_bus_write(emulated_bus* bus, uint16 port, uint8 value);
+
+#endif	// _IT87_EMULATOR_H_
@@ -0,0 +1,176 @@
+//
+// Copyright 2003-2006, 2022-2023, Oscar Lesta. All right reserved.
+// Distributed under the terms of the MIT License.
+//
+// See it87_replay.h.
+//
+
+#include "it87_replay.h"
+
+#include <stdio.h>
+
+#include "../it87_regs.h"
+#include "host.h"
+
+
+// Super I/O config index ports; the data port follows each one.
+static const uint16 kConfigPorts[] = { 0x2E, 0x4E };
+
+static replay_bus* sInstalledBus;
+
+
+static bool
+is_config_port(uint16 port)
+{
+	for (size_t i = 0; i < sizeof(kConfigPorts) / sizeof(kConfigPorts[0]); i++) {
+		if (kConfigPorts[i] == port)
+			return true;
+	}
+	return false;
+}
+
+
+// Port, index last written to the port before it, and logical device, with
+// -1 standing for none selected.
+static uint64
+register_key(const replay_selection& selection, uint16 port)
+{
+	int32 index = -1;
+	std::map<uint16, uint8>::const_iterator found = selection.written.find(port - 1);
+	if (found != selection.written.end())
+		index = found->second;
+
+	int32 device = -1;
+	found = selection.device.find(port);
+	if (found != selection.device.end())
+		device = found->second;
+
+	return ((uint64)port << 32) | ((uint64)(uint16)(index + 1) << 16)
+		| (uint16)(device + 1);
+}
+
+
+static void
+select_register(replay_selection& selection, uint16 port, uint8 value)
+{
+	std::map<uint16, uint8>::const_iterator index = selection.written.find(port - 1);
+	if (is_config_port(port - 1) && index != selection.written.end()
+		&& index->second == IT87_LDN)
+		selection.device[port] = value;
+
+	selection.written[port] = value;
+}
+
+
+void
+replay_bus_init(replay_bus* bus, const it87_port_op* ops, uint32 count)
+{
+	bus->registers.clear();
+	bus->selection = replay_selection();
+	bus->recorded = 0;
+	bus->replayed = 0;
+	bus->repeated = 0;
+	bus->unknown = 0;
+
+	// Sort the reads out by register, following what got selected on the way.
+	replay_selection selection;
+	for (uint32 i = 0; i < count; i++) {
+		if (ops[i].write) {
+			select_register(selection, ops[i].port, ops[i].value);
+			continue;
+		}
+
+		replay_register& reg = bus->registers[register_key(selection, ops[i].port)];
+		reg.values.push_back(ops[i].value);
+		reg.next = 0;
+		bus->recorded++;
+	}
+}
+
+
+uint8
+replay_bus_read(replay_bus* bus, uint16 port)
+{
+	std::map<uint64, replay_register>::iterator found
+		= bus->registers.find(register_key(bus->selection, port));
+	if (found == bus->registers.end()) {
+		bus->unknown++;
+		return 0xff;
+	}
+
+	replay_register& reg = found->second;
+	if (reg.next == reg.values.size()) {
+		bus->repeated++;
+		return reg.values.back();
+	}
+
+	bus->replayed++;
+	return reg.values[reg.next++];
+}
+
+
+void
+replay_bus_write(replay_bus* bus, uint16 port, uint8 value)
+{
+	select_register(bus->selection, port, value);
+}
+
+
+status_t
+replay_load_trace(const char* path, std::vector<it87_port_op>& ops)
+{
+	FILE* file = fopen(path, "rb");
+	if (file == NULL)
+		return B_ENTRY_NOT_FOUND;
+
+	// Anything but whole ops means it isn't a trace.
+	status_t status = B_OK;
+	long size = -1;
+	if (fseek(file, 0, SEEK_END) == 0)
+		size = ftell(file);
+	if (size < 0 || size % sizeof(it87_port_op) != 0)
+		status = B_BAD_VALUE;
+
+	size_t count = size / sizeof(it87_port_op);
+	if (status == B_OK && count > 0) {
+		size_t first = ops.size();
+		ops.resize(first + count);
+		rewind(file);
+		if (fread(&ops[first], sizeof(it87_port_op), count, file) != count) {
+			ops.resize(first);
+			status = B_ERROR;
+		}
+	}
+
+	fclose(file);
+	return status;
+}
+
+
+static uint8
+isa_read_io_8(int port)
+{
+	return replay_bus_read(sInstalledBus, port);
+}
+
+
+static void
+isa_write_io_8(int port, uint8 value)
+{
+	replay_bus_write(sInstalledBus, port, value);
+}
+
+
+static isa_module_info sISAModule = {
+	{ B_ISA_MODULE_NAME, 0, NULL },
+	isa_read_io_8,
+	isa_write_io_8,
+};
+
+
+void
+replay_bus_install(replay_bus* bus)
+{
+	sInstalledBus = bus;
+	host_set_isa_module(bus != NULL ? &sISAModule : NULL);
+}
@@ -0,0 +1,75 @@
+//
+// Copyright 2003-2006, 2022-2023, Oscar Lesta. All right reserved.
+// Distributed under the terms of the MIT License.
+//
+// An ISA bus that plays back port accesses recorded with the driver's tracing
+// (IT87_SENSORS_READ_TRACE, or it87_read_trace()), so whatever a chip answered
+// can be fed to the driver again, offline.
+//
+// Reads are played back per register, not in the order they were recorded: a
+// register is a data port, plus the index last written to the port before it
+// (and for the Super I/O config ports, the logical device selected). Each one
+// answers what it answered in the recording, in turn, and keeps answering the
+// last of those once they run out. So a replay doesn't have to go through the
+// very same accesses the recording did: the sampler running on its own time,
+// partial refreshes and monitoring being turned on and off are all fine.
+//
+// Writes aren't played back, they only select registers.
+//
+// To replay a chip from scratch, the recording has to hold its probe too: with
+// "trace_probe true" in the driver settings, tracing starts before the chip is
+// probed, and IT87_SENSORS_READ_TRACE returns that first (don't use
+// IT87_SENSORS_START_TRACE then, it starts over).
+//
+// Trace files, as replay_load_trace() and the replay_trace tool read them, are
+// the it87_port_op arrays IT87_SENSORS_READ_TRACE returns, one after the other,
+// written as they are (16 bytes each, in the byte order of the machine they
+// were taken on).
+//
+
+#ifndef _IT87_REPLAY_H_
+#define _IT87_REPLAY_H_
+
+#include <ISA.h>
+
+#include <map>
+#include <vector>
+
+#include "../it87.h"
+
+// Registers selected, as of the accesses seen so far.
+struct replay_selection {
+	std::map<uint16, uint8>	written;	// last value written, by port.
+	std::map<uint16, uint8>	device;		// logical device, by config data port.
+};
+
+struct replay_register {
+	std::vector<uint8>	values;		// as read in the recording, oldest first.
+	size_t				next;
+};
+
+struct replay_bus {
+	std::map<uint64, replay_register> registers;
+	replay_selection	selection;
+
+	uint32				recorded;	// reads in the recording.
+	uint32				replayed;	// recorded reads played back.
+	uint32				repeated;	// reads past the recorded ones of their
+									// register, answered with the last of them.
+	uint32				unknown;	// reads of registers never read in the
+									// recording, answered with 0xFF.
+};
+
+
+void		replay_bus_init(replay_bus* bus, const it87_port_op* ops, uint32 count);
+
+// Makes "bus" the one get_module(B_ISA_MODULE_NAME) hands out.
+void		replay_bus_install(replay_bus* bus);
+
+uint8		replay_bus_read(replay_bus* bus, uint16 port);
+void		replay_bus_write(replay_bus* bus, uint16 port, uint8 value);
+
+// Appends the ops in the trace file at "path" to "ops".
+status_t	replay_load_trace(const char* path, std::vector<it87_port_op>& ops);
+
+#endif	// _IT87_REPLAY_H_
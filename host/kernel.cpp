@@ -0,0 +1,933 @@
+//
+// Copyright 2003-2006, 2022-2023, Oscar Lesta. All right reserved.
+// Distributed under the terms of the MIT License.
+//
+// Kernel services the driver uses, on top of pthreads, so it can be built and
+// exercised on the host: atomics, semaphores, kernel threads, areas, modules,
+// driver settings and dprintf(). Semantics follow Haiku's as far as the
+// driver relies on them (timeouts, delete_sem() waking up waiters, etc.).
+//
+
+#include <Drivers.h>
+#include <KernelExport.h>
+#include <driver_settings.h>
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+
+#include "host.h"
+
+// Only drivers that export modules define this.
+extern "C" module_info* modules[] __attribute__((weak));
+
+static pthread_mutex_t sLock = PTHREAD_MUTEX_INITIALIZER;
+
+
+//-----------------------------------------------------------------------------
+//	#pragma mark - Time
+
+bigtime_t
+system_time(void)
+{
+	return host_nanotime() / 1000;
+}
+
+
+int64
+host_nanotime(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+
+void
+host_delay(int64 nanoseconds)
+{
+	if (nanoseconds <= 0)
+		return;
+
+	// Other threads get to run meanwhile, as they would on the other CPUs:
+	// this might be the only one.
+	int64 until = host_nanotime() + nanoseconds;
+	while (host_nanotime() < until)
+		sched_yield();
+}
+
+
+status_t
+snooze(bigtime_t amount)
+{
+	if (amount <= 0)
+		return B_OK;
+
+	struct timespec delay = { (time_t)(amount / 1000000), (long)(amount % 1000000) * 1000 };
+	while (nanosleep(&delay, &delay) != 0)
+		;
+	return B_OK;
+}
+
+
+status_t
+snooze_until(bigtime_t time, int timeBase)
+{
+	return snooze(time - system_time());
+}
+
+
+void
+spin(bigtime_t microseconds)
+{
+	host_delay(microseconds * 1000);
+}
+
+
+//-----------------------------------------------------------------------------
+//	#pragma mark - Atomics
+
+// All of them sequentially consistent, like the kernel's.
+void
+atomic_set(int32* value, int32 newValue)
+{
+	__atomic_store_n(value, newValue, __ATOMIC_SEQ_CST);
+}
+
+
+int32
+atomic_get_and_set(int32* value, int32 newValue)
+{
+	return __atomic_exchange_n(value, newValue, __ATOMIC_SEQ_CST);
+}
+
+
+int32
+atomic_test_and_set(int32* value, int32 newValue, int32 testAgainst)
+{
+	__atomic_compare_exchange_n(value, &testAgainst, newValue, false, __ATOMIC_SEQ_CST,
+		__ATOMIC_SEQ_CST);
+	return testAgainst;
+}
+
+
+int32
+atomic_add(int32* value, int32 addValue)
+{
+	return __atomic_fetch_add(value, addValue, __ATOMIC_SEQ_CST);
+}
+
+
+int32
+atomic_and(int32* value, int32 andValue)
+{
+	return __atomic_fetch_and(value, andValue, __ATOMIC_SEQ_CST);
+}
+
+
+int32
+atomic_or(int32* value, int32 orValue)
+{
+	return __atomic_fetch_or(value, orValue, __ATOMIC_SEQ_CST);
+}
+
+
+int32
+atomic_get(int32* value)
+{
+	return __atomic_load_n(value, __ATOMIC_SEQ_CST);
+}
+
+
+void
+atomic_set64(int64* value, int64 newValue)
+{
+	__atomic_store_n(value, newValue, __ATOMIC_SEQ_CST);
+}
+
+
+int64
+atomic_get_and_set64(int64* value, int64 newValue)
+{
+	return __atomic_exchange_n(value, newValue, __ATOMIC_SEQ_CST);
+}
+
+
+int64
+atomic_test_and_set64(int64* value, int64 newValue, int64 testAgainst)
+{
+	__atomic_compare_exchange_n(value, &testAgainst, newValue, false, __ATOMIC_SEQ_CST,
+		__ATOMIC_SEQ_CST);
+	return testAgainst;
+}
+
+
+int64
+atomic_add64(int64* value, int64 addValue)
+{
+	return __atomic_fetch_add(value, addValue, __ATOMIC_SEQ_CST);
+}
+
+
+int64
+atomic_get64(int64* value)
+{
+	return __atomic_load_n(value, __ATOMIC_SEQ_CST);
+}
+
+
+//-----------------------------------------------------------------------------
+//	#pragma mark - Semaphores
+
+struct host_sem {
+	pthread_mutex_t	lock;
+	pthread_cond_t	cond;
+	int32			count;
+	bool			deleted;
+
+	// Waiters get a ticket each, in arrival order. B_RELEASE_ALL lets everyone
+	// holding a ticket below "released" through, without leaving counts behind
+	// for whoever comes later.
+	uint64			next_ticket;
+	uint64			released;
+};
+
+// IDs are never reused, and deleted semaphores are never freed: a thread might
+// still be on its way out of acquire_sem_etc(). Looking them up takes no lock,
+// so they don't add contention of their own to what tests measure.
+#define HOST_MAX_SEMS	65536
+
+static host_sem* sSems[HOST_MAX_SEMS];
+static int32 sSemCount;
+
+
+static host_sem*
+lookup_sem(sem_id id)
+{
+	if (id <= 0 || id > HOST_MAX_SEMS)
+		return NULL;
+	return __atomic_load_n(&sSems[id - 1], __ATOMIC_ACQUIRE);
+}
+
+
+sem_id
+create_sem(int32 count, const char* name)
+{
+	if (count < 0)
+		return B_BAD_VALUE;
+
+	host_sem* sem = new host_sem;
+	pthread_mutex_init(&sem->lock, NULL);
+	pthread_condattr_t attributes;
+	pthread_condattr_init(&attributes);
+	pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+	pthread_cond_init(&sem->cond, &attributes);
+	pthread_condattr_destroy(&attributes);
+	sem->count = count;
+	sem->deleted = false;
+	sem->next_ticket = 0;
+	sem->released = 0;
+
+	sem_id id = atomic_add(&sSemCount, 1) + 1;
+	if (id > HOST_MAX_SEMS) {
+		delete sem;
+		return B_NO_MORE_SEMS;
+	}
+
+	__atomic_store_n(&sSems[id - 1], sem, __ATOMIC_RELEASE);
+	return id;
+}
+
+
+status_t
+delete_sem(sem_id id)
+{
+	if (id <= 0 || id > HOST_MAX_SEMS)
+		return B_BAD_SEM_ID;
+	host_sem* sem = __atomic_exchange_n(&sSems[id - 1], (host_sem*)NULL, __ATOMIC_ACQ_REL);
+	if (sem == NULL)
+		return B_BAD_SEM_ID;
+
+	pthread_mutex_lock(&sem->lock);
+	sem->deleted = true;
+	pthread_cond_broadcast(&sem->cond);
+	pthread_mutex_unlock(&sem->lock);
+	return B_OK;
+}
+
+
+// Releases "semToBeReleased" (if any) only once in line for "id", so nothing
+// released in between can be missed.
+static status_t
+acquire_sem_internal(sem_id semToBeReleased, sem_id id, int32 count, uint32 flags,
+	bigtime_t timeout)
+{
+	host_sem* sem = lookup_sem(id);
+	if (sem == NULL)
+		return B_BAD_SEM_ID;
+	if (count < 1)
+		return B_BAD_VALUE;
+
+	bigtime_t deadline = B_INFINITE_TIMEOUT;
+	if ((flags & B_RELATIVE_TIMEOUT) != 0 && timeout != B_INFINITE_TIMEOUT)
+		deadline = timeout > 0 ? system_time() + timeout : 0;
+	else if ((flags & B_ABSOLUTE_TIMEOUT) != 0)
+		deadline = timeout;
+
+	status_t status = B_OK;
+	pthread_mutex_lock(&sem->lock);
+	uint64 ticket = sem->next_ticket++;
+
+	if (semToBeReleased >= 0) {
+		status = release_sem(semToBeReleased);
+		if (status != B_OK) {
+			pthread_mutex_unlock(&sem->lock);
+			return status;
+		}
+	}
+
+	bool releasedAll = false;
+	while (!sem->deleted && sem->count < count) {
+		if (ticket < sem->released) {
+			releasedAll = true;
+			break;
+		}
+
+		if (deadline == B_INFINITE_TIMEOUT) {
+			pthread_cond_wait(&sem->cond, &sem->lock);
+			continue;
+		}
+
+		if (system_time() >= deadline) {
+			status = (flags & B_RELATIVE_TIMEOUT) != 0 && timeout <= 0
+				? B_WOULD_BLOCK : B_TIMED_OUT;
+			break;
+		}
+
+		struct timespec until = { (time_t)(deadline / 1000000),
+			(long)(deadline % 1000000) * 1000 };
+		pthread_cond_timedwait(&sem->cond, &sem->lock, &until);
+	}
+
+	if (sem->deleted)
+		status = B_BAD_SEM_ID;
+	else if (status == B_OK && !releasedAll)
+		sem->count -= count;
+	pthread_mutex_unlock(&sem->lock);
+
+	return status;
+}
+
+
+status_t
+acquire_sem_etc(sem_id id, int32 count, uint32 flags, bigtime_t timeout)
+{
+	return acquire_sem_internal(-1, id, count, flags, timeout);
+}
+
+
+status_t
+acquire_sem(sem_id id)
+{
+	return acquire_sem_etc(id, 1, 0, 0);
+}
+
+
+status_t
+switch_sem_etc(sem_id semToBeReleased, sem_id id, int32 count, uint32 flags,
+	bigtime_t timeout)
+{
+	return acquire_sem_internal(semToBeReleased, id, count, flags, timeout);
+}
+
+
+status_t
+switch_sem(sem_id semToBeReleased, sem_id id)
+{
+	return switch_sem_etc(semToBeReleased, id, 1, 0, 0);
+}
+
+
+// B_RELEASE_ALL only wakes up whoever is waiting right now.
+status_t
+release_sem_etc(sem_id id, int32 count, uint32 flags)
+{
+	host_sem* sem = lookup_sem(id);
+	if (sem == NULL)
+		return B_BAD_SEM_ID;
+	if (count < 1 && (flags & B_RELEASE_ALL) == 0)
+		return B_BAD_VALUE;
+
+	pthread_mutex_lock(&sem->lock);
+	if ((flags & B_RELEASE_ALL) != 0)
+		sem->released = sem->next_ticket;
+	else
+		sem->count += count;
+	pthread_cond_broadcast(&sem->cond);
+	pthread_mutex_unlock(&sem->lock);
+	return B_OK;
+}
+
+
+status_t
+release_sem(sem_id id)
+{
+	return release_sem_etc(id, 1, 0);
+}
+
+
+//-----------------------------------------------------------------------------
+//	#pragma mark - Threads
+
+struct host_thread {
+	pthread_t		thread;
+	thread_func		function;
+	void*			data;
+	sem_id			resume;		// released by resume_thread().
+	status_t		result;
+};
+
+static std::vector<host_thread*> sThreads;
+
+
+static void*
+thread_entry(void* _thread)
+{
+	host_thread* thread = (host_thread*)_thread;
+
+	// Kernel threads are spawned suspended.
+	acquire_sem(thread->resume);
+	thread->result = thread->function(thread->data);
+	return NULL;
+}
+
+
+thread_id
+spawn_kernel_thread(thread_func function, const char* name, int32 priority, void* data)
+{
+	host_thread* thread = new host_thread;
+	thread->function = function;
+	thread->data = data;
+	thread->resume = create_sem(0, name);
+	thread->result = B_OK;
+
+	if (pthread_create(&thread->thread, NULL, thread_entry, thread) != 0) {
+		delete_sem(thread->resume);
+		delete thread;
+		return B_NO_MEMORY;
+	}
+
+	pthread_mutex_lock(&sLock);
+	sThreads.push_back(thread);
+	thread_id id = sThreads.size();
+	pthread_mutex_unlock(&sLock);
+	return id;
+}
+
+
+static host_thread*
+lookup_thread(thread_id id)
+{
+	pthread_mutex_lock(&sLock);
+	host_thread* thread = id > 0 && (size_t)id <= sThreads.size() ? sThreads[id - 1] : NULL;
+	pthread_mutex_unlock(&sLock);
+	return thread;
+}
+
+
+status_t
+resume_thread(thread_id id)
+{
+	host_thread* thread = lookup_thread(id);
+	if (thread == NULL)
+		return B_BAD_THREAD_ID;
+
+	release_sem(thread->resume);
+	return B_OK;
+}
+
+
+status_t
+wait_for_thread(thread_id id, status_t* returnValue)
+{
+	pthread_mutex_lock(&sLock);
+	host_thread* thread = id > 0 && (size_t)id <= sThreads.size() ? sThreads[id - 1] : NULL;
+	if (thread != NULL)
+		sThreads[id - 1] = NULL;
+	pthread_mutex_unlock(&sLock);
+	if (thread == NULL)
+		return B_BAD_THREAD_ID;
+
+	// Waiting for a suspended thread resumes it.
+	release_sem(thread->resume);
+	pthread_join(thread->thread, NULL);
+
+	if (returnValue != NULL)
+		*returnValue = thread->result;
+	delete_sem(thread->resume);
+	delete thread;
+	return B_OK;
+}
+
+
+//-----------------------------------------------------------------------------
+//	#pragma mark - Areas
+
+// Clones share the block of the area they were cloned from.
+struct host_area_block {
+	void*	address;
+	int32	references;
+};
+
+static std::vector<host_area_block*> sAreas;
+
+
+static area_id
+add_area(host_area_block* block)
+{
+	pthread_mutex_lock(&sLock);
+	block->references++;
+	sAreas.push_back(block);
+	area_id id = sAreas.size();
+	pthread_mutex_unlock(&sLock);
+	return id;
+}
+
+
+area_id
+create_area(const char* name, void** startAddress, uint32 addressSpec, size_t size,
+	uint32 lock, uint32 protection)
+{
+	void* address;
+	if (size == 0 || posix_memalign(&address, B_PAGE_SIZE, size) != 0)
+		return B_NO_MEMORY;
+	memset(address, 0, size);
+
+	host_area_block* block = new host_area_block;
+	block->address = address;
+	block->references = 0;
+
+	*startAddress = address;
+	return add_area(block);
+}
+
+
+area_id
+clone_area(const char* name, void** destAddress, uint32 addressSpec, uint32 protection,
+	area_id source)
+{
+	pthread_mutex_lock(&sLock);
+	host_area_block* block = source > 0 && (size_t)source <= sAreas.size()
+		? sAreas[source - 1] : NULL;
+	pthread_mutex_unlock(&sLock);
+	if (block == NULL)
+		return B_BAD_VALUE;
+
+	*destAddress = block->address;
+	return add_area(block);
+}
+
+
+status_t
+delete_area(area_id id)
+{
+	pthread_mutex_lock(&sLock);
+	host_area_block* block = id > 0 && (size_t)id <= sAreas.size() ? sAreas[id - 1] : NULL;
+	if (block != NULL) {
+		sAreas[id - 1] = NULL;
+		if (--block->references > 0)
+			block = NULL;
+	} else
+		id = B_BAD_VALUE;
+	pthread_mutex_unlock(&sLock);
+
+	if (block != NULL) {
+		free(block->address);
+		delete block;
+	}
+	return id < 0 ? (status_t)id : B_OK;
+}
+
+
+//-----------------------------------------------------------------------------
+//	#pragma mark - Misc
+
+static bool sDebugOutput = getenv("IT87_HOST_DEBUG") != NULL;
+
+
+void
+host_set_debug_output(bool enabled)
+{
+	sDebugOutput = enabled;
+}
+
+
+void
+dprintf(const char* format, ...)
+{
+	if (!sDebugOutput)
+		return;
+
+	va_list args;
+	va_start(args, format);
+	vfprintf(stderr, format, args);
+	va_end(args);
+}
+
+
+status_t
+user_memcpy(void* to, const void* from, size_t size)
+{
+	if (size > 0 && (to == NULL || from == NULL))
+		return B_BAD_ADDRESS;
+
+	memcpy(to, from, size);
+	return B_OK;
+}
+
+
+status_t
+notify_select_event(selectsync* sync, uint8 event)
+{
+	atomic_add(&sync->events, 1);
+	return B_OK;
+}
+
+
+//-----------------------------------------------------------------------------
+//	#pragma mark - Modules
+
+static isa_module_info* sISAModule;
+static int32 sISAReferences;
+
+struct module_reference {
+	module_info*	info;
+	int32			references;
+};
+
+static std::vector<module_reference> sModules;
+
+
+void
+host_set_isa_module(isa_module_info* module)
+{
+	pthread_mutex_lock(&sLock);
+	sISAModule = module;
+	pthread_mutex_unlock(&sLock);
+}
+
+
+static module_info*
+find_module(const char* path)
+{
+	for (int32 i = 0; &modules != NULL && modules[i] != NULL; i++) {
+		if (strcmp(modules[i]->name, path) == 0)
+			return modules[i];
+	}
+	return NULL;
+}
+
+
+// Modules exported by the driver get their std_ops() called on first use, and
+// last release, like in the kernel.
+status_t
+get_module(const char* path, module_info** _info)
+{
+	if (strcmp(path, B_ISA_MODULE_NAME) == 0) {
+		pthread_mutex_lock(&sLock);
+		isa_module_info* module = sISAModule;
+		if (module != NULL)
+			sISAReferences++;
+		pthread_mutex_unlock(&sLock);
+
+		if (module == NULL)
+			return B_ENTRY_NOT_FOUND;
+		*_info = &module->binfo;
+		return B_OK;
+	}
+
+	module_info* info = find_module(path);
+	if (info == NULL)
+		return B_ENTRY_NOT_FOUND;
+
+	pthread_mutex_lock(&sLock);
+	size_t index = 0;
+	while (index < sModules.size() && sModules[index].info != info)
+		index++;
+	if (index == sModules.size()) {
+		module_reference reference = { info, 0 };
+		sModules.push_back(reference);
+	}
+	bool first = sModules[index].references++ == 0;
+	pthread_mutex_unlock(&sLock);
+
+	if (first && info->std_ops != NULL) {
+		status_t status = info->std_ops(B_MODULE_INIT);
+		if (status != B_OK) {
+			pthread_mutex_lock(&sLock);
+			sModules[index].references--;
+			pthread_mutex_unlock(&sLock);
+			return status;
+		}
+	}
+
+	*_info = info;
+	return B_OK;
+}
+
+
+status_t
+put_module(const char* path)
+{
+	if (strcmp(path, B_ISA_MODULE_NAME) == 0) {
+		pthread_mutex_lock(&sLock);
+		status_t status = sISAReferences > 0 ? B_OK : B_BAD_VALUE;
+		if (status == B_OK)
+			sISAReferences--;
+		pthread_mutex_unlock(&sLock);
+		return status;
+	}
+
+	module_info* info = find_module(path);
+	bool last = false;
+	pthread_mutex_lock(&sLock);
+	for (size_t i = 0; info != NULL && i < sModules.size(); i++) {
+		if (sModules[i].info == info && sModules[i].references > 0)
+			last = --sModules[i].references == 0;
+	}
+	pthread_mutex_unlock(&sLock);
+
+	if (last && info->std_ops != NULL)
+		info->std_ops(B_MODULE_UNINIT);
+	return info != NULL ? B_OK : B_ENTRY_NOT_FOUND;
+}
+
+
+//-----------------------------------------------------------------------------
+//	#pragma mark - Driver settings
+
+// Parsed with the same syntax as the kernel's: a parameter per line (or ';'),
+// its values after its name, and an optional block of sub-parameters in
+// braces. '#' starts a comment. No quoting or escaping, the driver doesn't
+// need any.
+
+struct settings_file {
+	std::string		name;
+	std::string		text;
+};
+
+static std::vector<settings_file> sSettingsFiles;
+
+
+void
+host_set_driver_settings(const char* name, const char* text)
+{
+	pthread_mutex_lock(&sLock);
+	for (size_t i = 0; i < sSettingsFiles.size(); i++) {
+		if (sSettingsFiles[i].name == name) {
+			sSettingsFiles.erase(sSettingsFiles.begin() + i);
+			break;
+		}
+	}
+	if (text != NULL) {
+		settings_file file = { name, text };
+		sSettingsFiles.push_back(file);
+	}
+	pthread_mutex_unlock(&sLock);
+}
+
+
+static std::vector<std::string>
+tokenize_settings(const std::string& text)
+{
+	std::vector<std::string> tokens;
+	size_t i = 0;
+	while (i < text.size()) {
+		char c = text[i];
+		if (c == '#') {
+			while (i < text.size() && text[i] != '\n')
+				i++;
+		} else if (c == '\n' || c == ';' || c == '{' || c == '}') {
+			tokens.push_back(std::string(1, c == ';' ? '\n' : c));
+			i++;
+		} else if (c == ' ' || c == '\t' || c == '\r') {
+			i++;
+		} else {
+			size_t start = i;
+			while (i < text.size() && strchr(" \t\r\n;{}#", text[i]) == NULL)
+				i++;
+			tokens.push_back(text.substr(start, i - start));
+		}
+	}
+	return tokens;
+}
+
+
+static char*
+copy_string(const std::string& string)
+{
+	return strdup(string.c_str());
+}
+
+
+// Parses parameters up to the closing brace (or the end), leaving "next" past it.
+static void
+parse_parameters(const std::vector<std::string>& tokens, size_t& next,
+	driver_parameter*& _parameters, int& _count)
+{
+	std::vector<driver_parameter> parameters;
+
+	while (next < tokens.size() && tokens[next] != "}") {
+		if (tokens[next] == "\n" || tokens[next] == "{") {
+			next++;
+			continue;
+		}
+
+		driver_parameter parameter = {};
+		parameter.name = copy_string(tokens[next++]);
+
+		std::vector<char*> values;
+		while (next < tokens.size() && tokens[next] != "\n" && tokens[next] != "{"
+			&& tokens[next] != "}")
+			values.push_back(copy_string(tokens[next++]));
+
+		parameter.value_count = values.size();
+		parameter.values = (char**)calloc(values.size() + 1, sizeof(char*));
+		for (size_t i = 0; i < values.size(); i++)
+			parameter.values[i] = values[i];
+
+		if (next < tokens.size() && tokens[next] == "{") {
+			next++;
+			parse_parameters(tokens, next, parameter.parameters, parameter.parameter_count);
+			if (next < tokens.size())
+				next++;	// the closing brace.
+		}
+
+		parameters.push_back(parameter);
+	}
+
+	_count = parameters.size();
+	_parameters = (driver_parameter*)calloc(parameters.size() + 1, sizeof(driver_parameter));
+	for (size_t i = 0; i < parameters.size(); i++)
+		_parameters[i] = parameters[i];
+}
+
+
+static void
+free_parameters(driver_parameter* parameters, int count)
+{
+	for (int i = 0; i < count; i++) {
+		free(parameters[i].name);
+		for (int j = 0; j < parameters[i].value_count; j++)
+			free(parameters[i].values[j]);
+		free(parameters[i].values);
+		free_parameters(parameters[i].parameters, parameters[i].parameter_count);
+	}
+	free(parameters);
+}
+
+
+void*
+load_driver_settings(const char* driverName)
+{
+	std::string text;
+	bool found = false;
+
+	pthread_mutex_lock(&sLock);
+	for (size_t i = 0; i < sSettingsFiles.size(); i++) {
+		if (sSettingsFiles[i].name == driverName) {
+			text = sSettingsFiles[i].text;
+			found = true;
+		}
+	}
+	pthread_mutex_unlock(&sLock);
+	if (!found)
+		return NULL;
+
+	std::vector<std::string> tokens = tokenize_settings(text);
+	size_t next = 0;
+
+	driver_settings* settings = (driver_settings*)calloc(1, sizeof(driver_settings));
+	parse_parameters(tokens, next, settings->parameters, settings->parameter_count);
+	return settings;
+}
+
+
+status_t
+unload_driver_settings(void* handle)
+{
+	driver_settings* settings = (driver_settings*)handle;
+	if (settings == NULL)
+		return B_BAD_VALUE;
+
+	free_parameters(settings->parameters, settings->parameter_count);
+	free(settings);
+	return B_OK;
+}
+
+
+const driver_settings*
+get_driver_settings(void* handle)
+{
+	return (const driver_settings*)handle;
+}
+
+
+// The last one wins, if a parameter is given more than once.
+static const driver_parameter*
+find_parameter(void* handle, const char* key)
+{
+	const driver_settings* settings = (const driver_settings*)handle;
+	if (settings == NULL)
+		return NULL;
+
+	for (int i = settings->parameter_count; i-- > 0;) {
+		if (strcmp(settings->parameters[i].name, key) == 0)
+			return &settings->parameters[i];
+	}
+	return NULL;
+}
+
+
+const char*
+get_driver_parameter(void* handle, const char* key, const char* unknownValue,
+	const char* noArgValue)
+{
+	const driver_parameter* parameter = find_parameter(handle, key);
+	if (parameter == NULL)
+		return unknownValue;
+	if (parameter->value_count == 0)
+		return noArgValue;
+	return parameter->values[0];
+}
+
+
+bool
+get_driver_boolean_parameter(void* handle, const char* key, bool unknownValue,
+	bool noArgValue)
+{
+	static const char* const kTrue[] = { "1", "true", "yes", "on", "enable", "enabled" };
+	static const char* const kFalse[] = { "0", "false", "no", "off", "disable", "disabled" };
+
+	const char* value = get_driver_parameter(handle, key, NULL, NULL);
+	if (find_parameter(handle, key) == NULL)
+		return unknownValue;
+	if (value == NULL)
+		return noArgValue;
+
+	for (size_t i = 0; i < B_COUNT_OF(kTrue); i++) {
+		if (strcasecmp(value, kTrue[i]) == 0)
+			return true;
+		if (strcasecmp(value, kFalse[i]) == 0)
+			return false;
+	}
+	return unknownValue;
+}
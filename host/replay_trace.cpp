@@ -0,0 +1,106 @@
+//
+// Copyright 2003-2006, 2022-2023, Oscar Lesta. All right reserved.
+// Distributed under the terms of the MIT License.
+//
+// Loads the driver against a trace file taken with "trace_probe true" (see
+// it87_replay.h), refreshes every chip it finds in there until the whole
+// recording got played back, and prints what the driver makes of it:
+//
+//	replay_trace <trace file> [driver settings file]
+//
+// The settings should be the ones the trace was taken with, for voltages to
+// get scaled the same way.
+//
+
+#include "test.h"
+
+#include <string>
+
+#include "it87_replay.h"
+
+
+static bool
+load_settings(const char* path, std::string& text)
+{
+	FILE* file = fopen(path, "r");
+	if (file == NULL)
+		return false;
+
+	char buffer[1024];
+	size_t length;
+	while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0)
+		text.append(buffer, length);
+
+	fclose(file);
+	return true;
+}
+
+
+static void
+replay_device(replay_bus* bus, const char* name)
+{
+	void* cookie = open_device(name);
+
+	// Each refresh plays back the next values of the registers it reads.
+	for (int i = 0; i < 100000 && bus->replayed < bus->recorded; i++) {
+		uint32 replayed = bus->replayed;
+		control_device(name, cookie, IT87_SENSORS_REFRESH, NULL, 0);
+		if (bus->replayed == replayed)
+			break;
+	}
+
+	char text[1024];
+	size_t length = sizeof(text) - 1;
+	if (find_device(name)->read(cookie, 0, text, &length) == B_OK) {
+		text[length] = '\0';
+		printf("%s:\n%s\n", name, text);
+	}
+
+	close_device(name, cookie);
+}
+
+
+int
+main(int argc, char** argv)
+{
+	if (argc < 2 || argc > 3) {
+		fprintf(stderr, "usage: %s <trace file> [driver settings file]\n", argv[0]);
+		return 2;
+	}
+
+	std::vector<it87_port_op> ops;
+	if (replay_load_trace(argv[1], ops) != B_OK || ops.empty()) {
+		fprintf(stderr, "%s: not a trace\n", argv[1]);
+		return 1;
+	}
+
+	std::string settings;
+	if (argc > 2 && !load_settings(argv[2], settings)) {
+		fprintf(stderr, "can't read %s\n", argv[2]);
+		return 1;
+	}
+	host_set_driver_settings("it87", argc > 2 ? settings.c_str() : NULL);
+
+	replay_bus bus;
+	replay_bus_init(&bus, &ops[0], ops.size());
+	replay_bus_install(&bus);
+
+	if (init_driver() != B_OK) {
+		fprintf(stderr, "%s: no supported chip in there, was it taken with "
+			"\"trace_probe true\"?\n", argv[1]);
+		return 1;
+	}
+
+	for (const char** names = publish_devices(); *names != NULL; names++) {
+		if (strncmp(*names, "sensor/it87/", strlen("sensor/it87/")) == 0)
+			replay_device(&bus, *names);
+	}
+
+	uninit_driver();
+	replay_bus_install(NULL);
+
+	printf("%zu ops, %" B_PRIu32 " reads: %" B_PRIu32 " played back, %" B_PRIu32
+		" repeated, %" B_PRIu32 " not in the trace\n", ops.size(), bus.recorded,
+		bus.replayed, bus.repeated, bus.unknown);
+	return 0;
+}
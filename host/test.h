@@ -0,0 +1,119 @@
+//
+// Copyright 2003-2006, 2022-2023, Oscar Lesta. All right reserved.
+// Distributed under the terms of the MIT License.
+//
+// Bits shared by the host tests and benchmarks. Each one is a program of its
+// own, returning non-zero on failure.
+//
+
+#ifndef _IT87_TEST_H_
+#define _IT87_TEST_H_
+
+#include <Drivers.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "../it87.h"
+#include "host.h"
+#include "it87_emulator.h"
+
+static int32 sFailures;
+
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) { \
+			fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+			atomic_add(&sFailures, 1); \
+		} \
+	} while (false)
+
+#define CHECK_EQUAL(a, b) \
+	do { \
+		long long _a = (a), _b = (b); \
+		if (_a != _b) { \
+			fprintf(stderr, "%s:%d: %s == %s failed: %lld != %lld\n", __FILE__, \
+				__LINE__, #a, #b, _a, _b); \
+			atomic_add(&sFailures, 1); \
+		} \
+	} while (false)
+
+
+static inline int
+test_result(const char* name)
+{
+	if (sFailures == 0) {
+		printf("%s: passed\n", name);
+		return 0;
+	}
+
+	printf("%s: %" B_PRId32 " check(s) failed\n", name, sFailures);
+	return 1;
+}
+
+
+// Opens "name" through the hooks the driver published for it.
+static inline void*
+open_device(const char* name, uint32 flags = 0)
+{
+	device_hooks* hooks = find_device(name);
+	void* cookie = NULL;
+	if (hooks == NULL || hooks->open(name, flags, &cookie) != B_OK) {
+		fprintf(stderr, "can't open %s\n", name);
+		exit(2);
+	}
+	return cookie;
+}
+
+
+static inline void
+close_device(const char* name, void* cookie)
+{
+	device_hooks* hooks = find_device(name);
+	hooks->close(cookie);
+	hooks->free(cookie);
+}
+
+
+static inline status_t
+control_device(const char* name, void* cookie, uint32 op, void* data, size_t length)
+{
+	return find_device(name)->control(cookie, op, data, length);
+}
+
+
+// Nanoseconds per operation, at the given percentile (0 to 100) of "samples".
+static inline int64
+percentile(std::vector<int64>& samples, double percent)
+{
+	if (samples.empty())
+		return 0;
+
+	std::sort(samples.begin(), samples.end());
+	size_t index = (size_t)(percent / 100 * (samples.size() - 1) + 0.5);
+	return samples[index];
+}
+
+
+// Sets up "chip" on "bus" with inputs that read as sane values.
+static inline void
+setup_chip(emulated_bus* bus, emulated_chip* chip, uint16 chipID, uint16 configPort,
+	uint16 baseAddress)
+{
+	emulated_chip_init(chip, chipID, configPort, baseAddress);
+	for (int i = 0; i < 9; i++)
+		chip->inputs[0x20 + i] = 100 + i * 10;
+	chip->inputs[0x29] = 40;
+	chip->inputs[0x2a] = 35;
+	chip->inputs[0x2b] = 30;
+	for (int fan = 0; fan < chip->fan_count; fan++)
+		emulated_chip_set_fan(chip, fan, chip->fans_16bit ? 600 + fan * 100 : 100 + fan * 10);
+
+	emulated_bus_add_chip(bus, chip);
+}
+
+#endif	// _IT87_TEST_H_
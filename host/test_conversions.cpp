@@ -0,0 +1,163 @@
+//
+// Copyright 2003-2006, 2022-2023, Oscar Lesta. All right reserved.
+// Distributed under the terms of the MIT License.
+//
+// Every ADC code, through every voltage preset, on each ADC resolution there
+// is, against the same math done in floating point. Plus the explicit ratios
+// that can't be represented.
+//
+
+#include "test.h"
+
+#include "../it87_regs.h"
+
+
+static const char* kDevice = "sensor/it87/0";
+
+// One chip per ADC resolution.
+static const struct {
+	uint16	id;
+	int32	resolution;		// µV
+} kChips[] = {
+	{ 0x8718, 16000 },
+	{ 0x8721, 12000 },
+	{ 0x8625, 10900 },
+};
+
+// Straight from the resistor dividers, see the Readme.
+static const struct {
+	const char*	name;
+	double		num;
+	double		den;
+	double		offset;		// mV
+} kPresets[] = {
+	{ "none",	1,		1,		0 },
+	{ "+5V",	6.8 + 10,	10,		0 },
+	{ "+12V",	30 + 10,	10,		0 },
+	{ "-12V",	56 + 232,	56,		-4096 * 232 / 56.0 },
+	{ "-5V",	56 + 120,	56,		-4096 * 120 / 56.0 },
+};
+
+
+static bool
+start(emulated_bus* bus, emulated_chip* chip, uint16 chipID, const char* settings)
+{
+	emulated_bus_init(bus);
+	setup_chip(bus, chip, chipID, 0x2E, 0x290);
+	emulated_bus_install(bus);
+
+	host_set_driver_settings("it87", settings);
+	return init_driver() == B_OK;
+}
+
+
+static void
+stop()
+{
+	uninit_driver();
+	host_set_driver_settings("it87", NULL);
+	emulated_bus_install(NULL);
+}
+
+
+static it87_sensors_data
+read_code(emulated_chip* chip, void* cookie, uint8 reg, uint8 code)
+{
+	chip->inputs[reg] = code;
+
+	it87_sensors_sample sample;
+	control_device(kDevice, cookie, IT87_SENSORS_REFRESH, &sample, sizeof(sample));
+	return sample.data;
+}
+
+
+static void
+test_presets()
+{
+	for (size_t c = 0; c < sizeof(kChips) / sizeof(kChips[0]); c++) {
+		for (size_t p = 0; p < sizeof(kPresets) / sizeof(kPresets[0]); p++) {
+			char settings[64];
+			snprintf(settings, sizeof(settings), "vin0 %s\n", kPresets[p].name);
+
+			emulated_bus bus;
+			emulated_chip chip;
+			CHECK(start(&bus, &chip, kChips[c].id, settings));
+			void* cookie = open_device(kDevice);
+
+			int failures = 0;
+			for (int code = 0; code < 256; code++) {
+				double expected = code * kChips[c].resolution / 1000.0
+					* kPresets[p].num / kPresets[p].den + kPresets[p].offset;
+				int16 value = read_code(&chip, cookie, IT87_REG_VIN0, code).voltages[0];
+
+				// Integer math truncates, and the -12V/-5V offsets are rounded.
+				if (value - expected <= -1.5 || value - expected >= 1.5) {
+					if (failures++ == 0) {
+						fprintf(stderr, "%04x, %s, code %d: %d mV, expected %.2f\n",
+							kChips[c].id, kPresets[p].name, code, value, expected);
+					}
+				}
+			}
+			CHECK_EQUAL(failures, 0);
+
+			close_device(kDevice, cookie);
+			stop();
+		}
+	}
+}
+
+
+// Ratios the top code would overflow an int16 with get ignored, the rest read
+// as they should all the way up.
+static void
+test_ratio_limits()
+{
+	emulated_bus bus;
+	emulated_chip chip;
+	CHECK(start(&bus, &chip, 0x8718, "vin1 8 1\nvin2 100 1\nvin3 11 1 -20000\n"
+		"vin4 3 1 32000\n"));
+	void* cookie = open_device(kDevice);
+
+	it87_sensors_data data = read_code(&chip, cookie, IT87_REG_VIN1, 255);
+	CHECK_EQUAL(data.voltages[1], 255 * 16 * 8);
+
+	// Left as they were: 1/1, +5V and +12V.
+	data = read_code(&chip, cookie, IT87_REG_VIN2, 255);
+	CHECK_EQUAL(data.voltages[2], 255 * 16);
+	data = read_code(&chip, cookie, IT87_REG_VIN4, 255);
+	CHECK_EQUAL(data.voltages[4], 255 * 16 * 4);
+
+	// Fine with an offset bringing it back in range.
+	data = read_code(&chip, cookie, IT87_REG_VIN3, 255);
+	CHECK_EQUAL(data.voltages[3], 255 * 16 * 11 - 20000);
+	data = read_code(&chip, cookie, IT87_REG_VIN3, 0);
+	CHECK_EQUAL(data.voltages[3], -20000);
+
+	close_device(kDevice, cookie);
+	stop();
+
+	// What fits depends on the ADC resolution.
+	CHECK(start(&bus, &chip, 0x8721, "vin1 10 1\n"));
+	cookie = open_device(kDevice);
+	data = read_code(&chip, cookie, IT87_REG_VIN1, 255);
+	CHECK_EQUAL(data.voltages[1], 255 * 12 * 10);
+	close_device(kDevice, cookie);
+	stop();
+
+	CHECK(start(&bus, &chip, 0x8718, "vin1 10 1\n"));
+	cookie = open_device(kDevice);
+	data = read_code(&chip, cookie, IT87_REG_VIN1, 255);
+	CHECK_EQUAL(data.voltages[1], 255 * 16);
+	close_device(kDevice, cookie);
+	stop();
+}
+
+
+int
+main()
+{
+	test_presets();
+	test_ratio_limits();
+
+	return test_result("test_conversions");
+}
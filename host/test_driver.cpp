@@ -0,0 +1,409 @@
+//
+// Copyright 2003-2006, 2022-2023, Oscar Lesta. All right reserved.
+// Distributed under the terms of the MIT License.
+//
+// The driver against simulated chips: probing on both config ports, values as
+// read through the hooks, monitoring on and off, limits, settings, waiting for
+// samples, and waking up from idle.
+//
+
+#include "test.h"
+
+#include <KernelExport.h>
+
+#include "../it87_regs.h"
+
+
+static void
+test_no_chip()
+{
+	emulated_bus bus;
+	emulated_bus_init(&bus);
+	emulated_bus_install(&bus);
+
+	CHECK_EQUAL(init_hardware(), B_DEVICE_NOT_FOUND);
+	CHECK(init_driver() != B_OK);
+
+	// Something that doesn't know the key, or isn't an ITE chip, isn't found either.
+	emulated_chip other;
+	emulated_chip_init(&other, 0x1234, 0x2E, 0x290);
+	emulated_bus_add_chip(&bus, &other);
+	CHECK_EQUAL(init_hardware(), B_DEVICE_NOT_FOUND);
+
+	emulated_bus_install(NULL);
+	CHECK(init_hardware() != B_OK);
+}
+
+
+static void
+test_probe()
+{
+	emulated_bus bus;
+	emulated_bus_init(&bus);
+	emulated_chip first, second;
+	setup_chip(&bus, &first, 0x8718, 0x2E, 0x290);
+	setup_chip(&bus, &second, 0x8705, 0x4E, 0xa30);
+	emulated_bus_install(&bus);
+
+	CHECK_EQUAL(init_hardware(), B_OK);
+	CHECK_EQUAL(init_driver(), B_OK);
+
+	const char** names = publish_devices();
+	int count = 0;
+	while (names[count] != NULL)
+		count++;
+	CHECK_EQUAL(count, 4);
+	CHECK(count == 4 && strcmp(names[0], "sensor/it87/0") == 0);
+	CHECK(count == 4 && strcmp(names[3], "sensor/it87_raw/1") == 0);
+
+	// Both left in "Wait for Key" state, with their EC turned on.
+	CHECK_EQUAL(first.key_state, 0);
+	CHECK_EQUAL(second.key_state, 0);
+	CHECK(first.ec_active && second.ec_active);
+
+	// 16-bit tachometers enabled on the chip that has them.
+	CHECK_EQUAL(first.ec[IT87_REG_FAN_16BITS] & 0x7, 0x7);
+	CHECK_EQUAL(second.ec[IT87_REG_FAN_16BITS], 0);
+
+	uninit_driver();
+	emulated_bus_install(NULL);
+}
+
+
+static void
+test_values()
+{
+	emulated_bus bus;
+	emulated_bus_init(&bus);
+	emulated_chip first, second;
+	setup_chip(&bus, &first, 0x8718, 0x2E, 0x290);
+	setup_chip(&bus, &second, 0x8705, 0x4E, 0xa30);
+	emulated_bus_install(&bus);
+	CHECK_EQUAL(init_driver(), B_OK);
+
+	// Monitoring is off until someone opens the device, so nothing got latched.
+	CHECK_EQUAL(first.ec[IT87_REG_CONFIG] & 1, 0);
+	CHECK_EQUAL(first.conversions, 0);
+
+	void* cookie = open_device("sensor/it87/0");
+	CHECK_EQUAL(first.ec[IT87_REG_CONFIG] & 1, 1);
+
+	it87_sensors_data data;
+	CHECK_EQUAL(control_device("sensor/it87/0", cookie, IT87_SENSORS_READ, &data,
+		sizeof(data)), B_OK);
+	CHECK_EQUAL(data.voltages[0], 100 * 16);
+	CHECK_EQUAL(data.voltages[3], 130 * 16 * 168 / 100);	// +5V divider.
+	CHECK_EQUAL(data.voltages[4], 140 * 16 * 4);			// +12V divider.
+	CHECK_EQUAL(data.temps[0], 40);
+	CHECK_EQUAL(data.temps[1], 35);
+	CHECK_EQUAL(data.fans[0], 675000 / 600);
+	CHECK_EQUAL(data.fans[4], 675000 / 1000);
+
+	// A refresh takes no more port accesses than it should.
+	it87_sensors_stats stats;
+	control_device("sensor/it87/0", cookie, IT87_SENSORS_GET_STATS, &stats, sizeof(stats));
+	CHECK_EQUAL(stats.refresh_port_ops, stats.refresh_port_budget);
+	CHECK_EQUAL(stats.over_budget_refreshes, 0);
+
+	char text[1024];
+	size_t length = sizeof(text) - 1;
+	CHECK_EQUAL(find_device("sensor/it87/0")->read(cookie, 0, text, &length), B_OK);
+	text[length] = '\0';
+	CHECK(strstr(text, "VIN0 :   1.600 V\n") != NULL);
+	CHECK(strstr(text, "TEMP1:   35 °C\n") != NULL);
+	CHECK(strstr(text, "FAN5 :  675 RPM\n") != NULL);
+
+	// 8-bit tachometers, and only three of them, on the other one.
+	void* other = open_device("sensor/it87/1");
+	CHECK_EQUAL(control_device("sensor/it87/1", other, IT87_SENSORS_READ, &data,
+		sizeof(data)), B_OK);
+	CHECK_EQUAL(data.fans[0], 1350000 / (100 * 2));
+	CHECK_EQUAL(data.fans[2], 1350000 / (120 * 2));
+	CHECK_EQUAL(data.fans[3], 0);
+	close_device("sensor/it87/1", other);
+	CHECK_EQUAL(second.ec[IT87_REG_CONFIG] & 1, 0);
+
+	// Limits trip alarms on the next sample.
+	it87_sensors_limits limits = {};
+	limits.channels = IT87_CHANNEL_MASK(IT87_CHANNEL_VIN0);
+	limits.low[IT87_CHANNEL_VIN0] = 500;
+	limits.high[IT87_CHANNEL_VIN0] = 1000;
+	CHECK_EQUAL(control_device("sensor/it87/0", cookie, IT87_SENSORS_SET_LIMITS, &limits,
+		sizeof(limits)), B_OK);
+	CHECK_EQUAL(limits.valid, IT87_CHANNEL_MASK(IT87_CHANNEL_VIN0));
+
+	it87_sensors_sample sample;
+	CHECK_EQUAL(control_device("sensor/it87/0", cookie, IT87_SENSORS_REFRESH, &sample,
+		sizeof(sample)), B_OK);
+	CHECK_EQUAL(sample.alarms, IT87_CHANNEL_MASK(IT87_CHANNEL_VIN0));
+
+	close_device("sensor/it87/0", cookie);
+	CHECK_EQUAL(first.ec[IT87_REG_CONFIG] & 1, 0);
+
+	uninit_driver();
+	emulated_bus_install(NULL);
+}
+
+
+static void
+test_settings()
+{
+	emulated_bus bus;
+	emulated_bus_init(&bus);
+	emulated_chip chip;
+	setup_chip(&bus, &chip, 0x8721, 0x2E, 0x290);
+	emulated_bus_install(&bus);
+
+	host_set_driver_settings("it87",
+		"# Comments, presets and ratios, global and per device.\n"
+		"vin1 2 1\n"
+		"device 0 {\n"
+		"	vin2 +12v\n"
+		"}\n"
+		"device 1 { vin1 3 1 }\n");
+	CHECK_EQUAL(init_driver(), B_OK);
+
+	void* cookie = open_device("sensor/it87/0");
+	it87_sensors_data data;
+	control_device("sensor/it87/0", cookie, IT87_SENSORS_READ, &data, sizeof(data));
+	CHECK_EQUAL(data.voltages[0], 100 * 12);
+	CHECK_EQUAL(data.voltages[1], 110 * 12 * 2);
+	CHECK_EQUAL(data.voltages[2], 120 * 12 * 4);
+	close_device("sensor/it87/0", cookie);
+
+	uninit_driver();
+	host_set_driver_settings("it87", NULL);
+	emulated_bus_install(NULL);
+}
+
+
+static status_t
+refresh_later(void* data)
+{
+	snooze(50000);
+	void* cookie = open_device("sensor/it87/0");
+	control_device("sensor/it87/0", cookie, IT87_SENSORS_REFRESH, NULL, 0);
+	close_device("sensor/it87/0", cookie);
+	return B_OK;
+}
+
+
+// Blocks in IT87_SENSORS_WAIT until another thread refreshes, and returns how
+// many times the snapshot got read meanwhile.
+static int64
+blocking_wait(void* cookie)
+{
+	control_device("sensor/it87/0", cookie, IT87_SENSORS_RESET_STATS, NULL, 0);
+
+	thread_id thread = spawn_kernel_thread(refresh_later, "refresh", B_NORMAL_PRIORITY,
+		NULL);
+	resume_thread(thread);
+
+	it87_sensors_wait wait = {};
+	wait.sequence = -1;
+	wait.timeout = 1000000;
+	CHECK_EQUAL(control_device("sensor/it87/0", cookie, IT87_SENSORS_WAIT, &wait,
+		sizeof(wait)), B_OK);
+
+	status_t result;
+	wait_for_thread(thread, &result);
+
+	it87_sensors_stats stats;
+	control_device("sensor/it87/0", cookie, IT87_SENSORS_GET_STATS, &stats, sizeof(stats));
+	return stats.snapshot_reads;
+}
+
+
+// The snapshot gets read a handful of times: by the wait itself, the refresh
+// and the sampler. Not once per earlier wait that didn't block, nor anything
+// left over from them for the next one.
+static void
+check_blocking_waits(void* cookie)
+{
+	CHECK(blocking_wait(cookie) < 20);
+	CHECK(blocking_wait(cookie) < 20);
+}
+
+
+// Waits that return without blocking (sample already there, timeouts,
+// O_NONBLOCK reads) can't leave anything behind for the next blocking one.
+static void
+test_wait()
+{
+	emulated_bus bus;
+	emulated_bus_init(&bus);
+	emulated_chip chip;
+	setup_chip(&bus, &chip, 0x8718, 0x2E, 0x290);
+	emulated_bus_install(&bus);
+
+	host_set_driver_settings("it87", "adaptive_sampling false\nsample_period 60000\n");
+	CHECK_EQUAL(init_driver(), B_OK);
+	void* cookie = open_device("sensor/it87/0");
+
+	check_blocking_waits(cookie);
+
+	for (int i = 0; i < 200; i++) {
+		it87_sensors_wait wait = {};
+		wait.sequence = 0;
+		wait.timeout = B_INFINITE_TIMEOUT;
+		CHECK_EQUAL(control_device("sensor/it87/0", cookie, IT87_SENSORS_WAIT, &wait,
+			sizeof(wait)), B_OK);
+		CHECK(wait.sequence != 0);
+	}
+	check_blocking_waits(cookie);
+
+	for (int i = 0; i < 20; i++) {
+		it87_sensors_wait wait = {};
+		wait.sequence = -1;
+		wait.timeout = 1000;
+		CHECK_EQUAL(control_device("sensor/it87/0", cookie, IT87_SENSORS_WAIT, &wait,
+			sizeof(wait)), B_TIMED_OUT);
+	}
+	check_blocking_waits(cookie);
+
+	// Binary reads: the first one gets the sample this cookie hasn't seen, then
+	// there's nothing new.
+	void* binary = open_device("sensor/it87/0", O_NONBLOCK);
+	it87_sensors_subscription subscription = {};
+	subscription.channels = ~(uint32)0;
+	subscription.format = IT87_FORMAT_BINARY;
+	control_device("sensor/it87/0", binary, IT87_SENSORS_SET_SUBSCRIPTION, &subscription,
+		sizeof(subscription));
+
+	it87_sensors_sample sample;
+	size_t length = sizeof(sample);
+	CHECK_EQUAL(find_device("sensor/it87/0")->read(binary, 0, &sample, &length), B_OK);
+	CHECK_EQUAL(length, sizeof(sample));
+	for (int i = 0; i < 200; i++) {
+		length = sizeof(sample);
+		CHECK_EQUAL(find_device("sensor/it87/0")->read(binary, 0, &sample, &length),
+			B_WOULD_BLOCK);
+		CHECK_EQUAL(length, 0);
+	}
+	close_device("sensor/it87/0", binary);
+	check_blocking_waits(cookie);
+
+	// Same for raw records. Sampling goes up to every 100 ms while that's open,
+	// so there might be a new one now and then.
+	void* raw = open_device("sensor/it87_raw/0", O_NONBLOCK);
+	it87_sensors_raw_record records[4];
+	length = sizeof(records);
+	CHECK_EQUAL(find_device("sensor/it87_raw/0")->read(raw, 0, records, &length), B_OK);
+	CHECK(length >= sizeof(it87_sensors_raw_record));
+	int blocked = 0;
+	for (int i = 0; i < 200; i++) {
+		length = sizeof(records);
+		if (find_device("sensor/it87_raw/0")->read(raw, 0, records, &length)
+				== B_WOULD_BLOCK)
+			blocked++;
+	}
+	CHECK(blocked > 100);
+	close_device("sensor/it87_raw/0", raw);
+	check_blocking_waits(cookie);
+
+	close_device("sensor/it87/0", cookie);
+	uninit_driver();
+	host_set_driver_settings("it87", NULL);
+	emulated_bus_install(NULL);
+}
+
+
+static int32 sGo;
+
+struct reader {
+	void*				cookie;
+	it87_sensors_data	data;
+};
+
+
+static status_t
+read_after_wakeup(void* _reader)
+{
+	reader& reader = *(struct reader*)_reader;
+
+	while (atomic_get(&sGo) == 0)
+		snooze(1000);
+
+	control_device("sensor/it87/0", reader.cookie, IT87_SENSORS_READ, &reader.data,
+		sizeof(reader.data));
+	return B_OK;
+}
+
+
+// Requests arriving at once after sampling stopped for being idle, on a chip
+// taking its time to convert: none of them gets the values from before.
+static void
+test_idle_wakeup()
+{
+	const int kThreads = 8;
+
+	emulated_bus bus;
+	emulated_bus_init(&bus);
+	emulated_chip chip;
+	setup_chip(&bus, &chip, 0x8718, 0x2E, 0x290);
+	chip.conversion_time = IT87_CONVERSION_TIME * 1000LL / 2;
+	emulated_bus_install(&bus);
+
+	host_set_driver_settings("it87",
+		"adaptive_sampling false\nsample_period 100\nidle_timeout 1\n");
+	CHECK_EQUAL(init_driver(), B_OK);
+
+	void* cookie = open_device("sensor/it87/0");
+	it87_sensors_data data;
+	control_device("sensor/it87/0", cookie, IT87_SENSORS_READ, &data, sizeof(data));
+	CHECK_EQUAL(data.voltages[0], 100 * 16);
+
+	reader readers[kThreads];
+	for (int i = 0; i < kThreads; i++)
+		readers[i].cookie = open_device("sensor/it87/0");
+
+	// Watch the chip itself: asking the driver would keep it awake.
+	bigtime_t deadline = system_time() + 5000000;
+	while ((chip.ec[IT87_REG_CONFIG] & 1) != 0 && system_time() < deadline)
+		snooze(10000);
+	CHECK_EQUAL(chip.ec[IT87_REG_CONFIG] & 1, 0);
+
+	chip.inputs[IT87_REG_VIN0] = 200;
+	emulated_chip_set_fan(&chip, 0, 900);
+
+	thread_id threads[kThreads];
+	atomic_set(&sGo, 0);
+	for (int i = 0; i < kThreads; i++) {
+		threads[i] = spawn_kernel_thread(read_after_wakeup, "reader", B_NORMAL_PRIORITY,
+			&readers[i]);
+		resume_thread(threads[i]);
+	}
+	atomic_set(&sGo, 1);
+
+	status_t result;
+	for (int i = 0; i < kThreads; i++) {
+		wait_for_thread(threads[i], &result);
+		CHECK_EQUAL(readers[i].data.voltages[0], 200 * 16);
+		CHECK_EQUAL(readers[i].data.fans[0], 675000 / 900);
+		close_device("sensor/it87/0", readers[i].cookie);
+	}
+
+	it87_sensors_stats stats;
+	control_device("sensor/it87/0", cookie, IT87_SENSORS_GET_STATS, &stats, sizeof(stats));
+	CHECK_EQUAL(stats.idle_stops, 1);
+	CHECK_EQUAL(stats.idle_wakeups, 1);
+
+	close_device("sensor/it87/0", cookie);
+	uninit_driver();
+	host_set_driver_settings("it87", NULL);
+	emulated_bus_install(NULL);
+}
+
+
+int
+main()
+{
+	test_no_chip();
+	test_probe();
+	test_values();
+	test_settings();
+	test_wait();
+	test_idle_wakeup();
+
+	return test_result("test_driver");
+}
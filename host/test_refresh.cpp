@@ -0,0 +1,125 @@
+//
+// Copyright 2003-2006, 2022-2023, Oscar Lesta. All right reserved.
+// Distributed under the terms of the MIT License.
+//
+// Many threads asking for IT87_SENSORS_REFRESH at once, on a bus as slow as an
+// LPC one: the ones arriving while a refresh is in flight share its sample, so
+// more threads get more calls served, and the chip sees the same number of port
+// accesses per sample no matter how many ask.
+//
+
+#include "test.h"
+
+#include <KernelExport.h>
+
+
+static const char* kDevice = "sensor/it87/0";
+static const bigtime_t kRoundTime = 200000;
+
+static int32 sStop;
+
+
+static status_t
+refresh_thread(void* data)
+{
+	int64& calls = *(int64*)data;
+	void* cookie = open_device(kDevice);
+
+	it87_sensors_sample sample;
+	while (atomic_get(&sStop) == 0) {
+		if (control_device(kDevice, cookie, IT87_SENSORS_REFRESH, &sample,
+				sizeof(sample)) == B_OK)
+			calls++;
+	}
+
+	close_device(kDevice, cookie);
+	return B_OK;
+}
+
+
+// Returns calls served per second.
+static double
+refresh_round(emulated_bus* bus, void* cookie, int32 threadCount)
+{
+	control_device(kDevice, cookie, IT87_SENSORS_RESET_STATS, NULL, 0);
+	int64 portOps = bus->reads + bus->writes;
+
+	std::vector<int64> calls(threadCount);
+	std::vector<thread_id> threads(threadCount);
+	atomic_set(&sStop, 0);
+
+	bigtime_t start = system_time();
+	for (int32 i = 0; i < threadCount; i++) {
+		threads[i] = spawn_kernel_thread(refresh_thread, "refresh", B_NORMAL_PRIORITY,
+			&calls[i]);
+		resume_thread(threads[i]);
+	}
+
+	snooze(kRoundTime);
+	atomic_set(&sStop, 1);
+
+	status_t result;
+	for (int32 i = 0; i < threadCount; i++)
+		wait_for_thread(threads[i], &result);
+	bigtime_t elapsed = system_time() - start;
+	portOps = bus->reads + bus->writes - portOps;
+
+	int64 total = 0;
+	for (int32 i = 0; i < threadCount; i++)
+		total += calls[i];
+
+	it87_sensors_stats stats;
+	control_device(kDevice, cookie, IT87_SENSORS_GET_STATS, &stats, sizeof(stats));
+
+	double perSample = stats.refreshes > 0 ? (double)portOps / stats.refreshes : 0;
+	double callsPerSecond = total * 1000000.0 / elapsed;
+	printf("%3" B_PRId32 " threads: %8.0f calls/s, %6" B_PRId64 " refreshes, %6" B_PRId64
+		" coalesced, %5.1f port ops per sample (budget %" B_PRId64 ")\n", threadCount,
+		callsPerSecond, stats.refreshes, stats.coalesced_refreshes, perSample,
+		stats.refresh_port_budget);
+
+	CHECK(stats.refreshes > 0);
+	CHECK(perSample <= stats.refresh_port_budget);
+	CHECK_EQUAL(stats.refresh_port_ops, stats.refresh_port_budget);
+	CHECK_EQUAL(stats.over_budget_refreshes, 0);
+	if (threadCount > 1)
+		CHECK(stats.coalesced_refreshes > 0);
+
+	return callsPerSecond;
+}
+
+
+int
+main()
+{
+	emulated_bus bus;
+	emulated_bus_init(&bus);
+	emulated_chip chip;
+	setup_chip(&bus, &chip, 0x8718, 0x2E, 0x290);
+	emulated_bus_install(&bus);
+
+	// Only the threads below refresh.
+	host_set_driver_settings("it87", "adaptive_sampling false\nsample_period 60000\n");
+	CHECK_EQUAL(init_driver(), B_OK);
+	void* cookie = open_device(kDevice);
+
+	// About what an LPC bus takes.
+	bus.latency = 1000;
+
+	double single = refresh_round(&bus, cookie, 1);
+	double most = single;
+	for (int32 threads = 2; threads <= 64; threads *= 2)
+		most = std::max(most, refresh_round(&bus, cookie, threads));
+
+	// More than one thread's worth of calls served. How far it keeps rising
+	// with more threads depends on how many CPUs there are to run them.
+	CHECK(most > single * 1.5);
+
+	bus.latency = 0;
+	close_device(kDevice, cookie);
+	uninit_driver();
+	host_set_driver_settings("it87", NULL);
+	emulated_bus_install(NULL);
+
+	return test_result("test_refresh");
+}
@@ -0,0 +1,283 @@
+//
+// Copyright 2003-2006, 2022-2023, Oscar Lesta. All right reserved.
+// Distributed under the terms of the MIT License.
+//
+// Records port accesses against a simulated chip, then replays them into
+// it87_probe() and the refresh routines, and into the driver as a whole: the
+// replay has to come up with the same values, without the chip.
+//
+
+#include "test.h"
+
+#include <unistd.h>
+
+#include "../it87_core.h"
+#include "../it87_regs.h"
+#include "it87_replay.h"
+
+
+static void
+use_installed_bus()
+{
+	if (gISA != NULL)
+		put_module(B_ISA_MODULE_NAME);
+	gISA = NULL;
+	get_module(B_ISA_MODULE_NAME, (module_info**)&gISA);
+}
+
+
+static uint32
+drain_trace(it87_chip* chip, std::vector<it87_port_op>& ops)
+{
+	it87_port_op buffer[256];
+	uint32 dropped = 0;
+	uint32 count;
+	while ((count = it87_read_trace(chip, buffer, 256, dropped)) > 0)
+		ops.insert(ops.end(), buffer, buffer + count);
+	return dropped;
+}
+
+
+static bool
+same_data(const it87_sensors_data& a, const it87_sensors_data& b)
+{
+	return memcmp(&a, &b, sizeof(it87_sensors_data)) == 0;
+}
+
+
+// Probe, start monitoring, and refresh a few times with inputs changing in
+// between. Then do the same against the recording.
+static void
+test_probe_and_refresh(uint16 chipID, uint16 configPort)
+{
+	const int kRefreshes = 4;
+
+	emulated_bus bus;
+	emulated_bus_init(&bus);
+	emulated_chip emulated;
+	setup_chip(&bus, &emulated, chipID, configPort, 0xa30);
+	emulated_bus_install(&bus);
+	use_installed_bus();
+
+	it87_chip chip;
+	memset(&chip, 0, sizeof(chip));
+	chip.config_port = configPort;
+	CHECK_EQUAL(it87_start_trace(&chip), B_OK);
+	CHECK_EQUAL(it87_probe(&chip), B_OK);
+	it87_config(&chip, true);
+
+	it87_sensors_data recorded[kRefreshes];
+	it87_sensors_raw recordedRaw[kRefreshes];
+	for (int i = 0; i < kRefreshes; i++) {
+		emulated.inputs[IT87_REG_VIN0 + i] += 7;
+		emulated.inputs[IT87_REG_TEMP0] += 3;
+		emulated_chip_set_fan(&emulated, 0, 500 + i * 40);
+
+		memset(&recorded[i], 0, sizeof(recorded[i]));
+		memset(&recordedRaw[i], 0, sizeof(recordedRaw[i]));
+		chip.info->refresh(&chip, recorded[i], recordedRaw[i]);
+	}
+
+	std::vector<it87_port_op> ops;
+	CHECK_EQUAL(drain_trace(&chip, ops), 0);
+	CHECK_EQUAL(ops.size(), (size_t)(bus.reads + bus.writes));
+	it87_stop_trace(&chip);
+
+	// Now without the chip.
+	replay_bus replay;
+	replay_bus_init(&replay, &ops[0], ops.size());
+	replay_bus_install(&replay);
+	use_installed_bus();
+
+	it87_chip replayed;
+	memset(&replayed, 0, sizeof(replayed));
+	replayed.config_port = configPort;
+	CHECK_EQUAL(it87_probe(&replayed), B_OK);
+	CHECK_EQUAL(replayed.chip_id, chip.chip_id);
+	CHECK_EQUAL(replayed.base_address, 0xa30);
+	CHECK_EQUAL(replayed.available_channels, chip.available_channels);
+	it87_config(&replayed, true);
+
+	for (int i = 0; i < kRefreshes; i++) {
+		it87_sensors_data data = {};
+		it87_sensors_raw raw = {};
+		replayed.info->refresh(&replayed, data, raw);
+		CHECK(same_data(data, recorded[i]));
+		CHECK(memcmp(&raw, &recordedRaw[i], sizeof(raw)) == 0);
+	}
+
+	CHECK_EQUAL(replay.replayed, replay.recorded);
+	CHECK_EQUAL(replay.repeated, 0);
+	CHECK_EQUAL(replay.unknown, 0);
+
+	// Past the recording, registers keep reading as they last did.
+	it87_sensors_data data = {};
+	it87_sensors_raw raw = {};
+	replayed.info->refresh(&replayed, data, raw);
+	CHECK(same_data(data, recorded[kRefreshes - 1]));
+	CHECK(replay.repeated > 0);
+	CHECK_EQUAL(replay.unknown, 0);
+
+	// Values do come from the recording: change one, and it shows.
+	for (size_t i = ops.size(); i-- > 0;) {
+		if (!ops[i].write && ops[i].port == 0xa30 + IT87_DATA_PORT_OFFSET) {
+			ops[i].value ^= 0x10;
+			break;
+		}
+	}
+	replay_bus_init(&replay, &ops[0], ops.size());
+	memset(&replayed, 0, sizeof(replayed));
+	replayed.config_port = configPort;
+	it87_probe(&replayed);
+	it87_config(&replayed, true);
+	for (int i = 0; i < kRefreshes; i++)
+		replayed.info->refresh(&replayed, data, raw);
+	CHECK(!same_data(data, recorded[kRefreshes - 1]));
+	CHECK_EQUAL(replay.unknown, 0);
+
+	// And there's no chip where none was recorded.
+	replay_bus_init(&replay, &ops[0], ops.size());
+	memset(&replayed, 0, sizeof(replayed));
+	replayed.config_port = configPort == 0x2E ? 0x4E : 0x2E;
+	CHECK(it87_probe(&replayed) != B_OK);
+	CHECK(replay.unknown > 0);
+	CHECK_EQUAL(replay.replayed, 0);
+
+	put_module(B_ISA_MODULE_NAME);
+	gISA = NULL;
+	replay_bus_install(NULL);
+}
+
+
+// Takes a trace the way one would on real hardware: "trace_probe true", and the
+// adaptive sampler doing partial refreshes on its own time while the inputs
+// change, then stopping for lack of requests and starting again. Then loads
+// the driver against it, through a trace file.
+static void
+test_driver_trace()
+{
+	const char* name = "sensor/it87/0";
+
+	emulated_bus bus;
+	emulated_bus_init(&bus);
+	emulated_chip emulated;
+	setup_chip(&bus, &emulated, 0x8728, 0x2E, 0x290);
+	emulated_bus_install(&bus);
+
+	host_set_driver_settings("it87", "trace_probe true\nmax_sample_period 300\n"
+		"idle_timeout 1\n");
+	CHECK_EQUAL(init_driver(), B_OK);
+	void* cookie = open_device(name);
+
+	// Voltages keep moving, temperatures don't, so they get sampled apart.
+	it87_sensors_sample samples[4];
+	for (int i = 0; i < 3; i++) {
+		emulated.inputs[IT87_REG_VIN7] = 50 + i * 20;
+		emulated_chip_set_fan(&emulated, 4, 900 - i * 100);
+		control_device(name, cookie, IT87_SENSORS_REFRESH, &samples[i], sizeof(samples[i]));
+		snooze(250000);
+	}
+
+	for (int i = 0; i < 300 && (emulated.ec[IT87_REG_CONFIG] & 1) != 0; i++)
+		snooze(10000);
+	CHECK_EQUAL(emulated.ec[IT87_REG_CONFIG] & 1, 0);
+
+	emulated.inputs[IT87_REG_TEMP2] = 55;
+	control_device(name, cookie, IT87_SENSORS_REFRESH, &samples[3], sizeof(samples[3]));
+	it87_sensors_stats stats;
+	control_device(name, cookie, IT87_SENSORS_GET_STATS, &stats, sizeof(stats));
+	CHECK_EQUAL(stats.idle_stops, 1);
+	CHECK_EQUAL(stats.idle_wakeups, 1);
+	CHECK(stats.refreshes > 4);
+
+	std::vector<it87_port_op> ops(IT87_TRACE_SIZE);
+	it87_sensors_trace trace = { IT87_TRACE_SIZE, 0, &ops[0] };
+	CHECK_EQUAL(control_device(name, cookie, IT87_SENSORS_READ_TRACE, &trace, sizeof(trace)),
+		B_OK);
+	CHECK_EQUAL(trace.dropped, 0);
+	ops.resize(trace.count);
+	control_device(name, cookie, IT87_SENSORS_STOP_TRACE, NULL, 0);
+
+	// Starting with the probe: entering the MB PnP mode.
+	CHECK(ops.size() > 0 && ops[0].write && ops[0].port == 0x2E && ops[0].value == 0x87);
+
+	// With voltages read more often than temperatures.
+	int voltageReads = 0, temperatureReads = 0;
+	uint8 index = 0;
+	for (size_t i = 0; i < ops.size(); i++) {
+		if (ops[i].write && ops[i].port == 0x290 + IT87_ADDR_PORT_OFFSET)
+			index = ops[i].value;
+		else if (!ops[i].write && ops[i].port == 0x290 + IT87_DATA_PORT_OFFSET) {
+			voltageReads += index == IT87_REG_VIN7;
+			temperatureReads += index == IT87_REG_TEMP0;
+		}
+	}
+	CHECK(voltageReads > temperatureReads);
+
+	close_device(name, cookie);
+	uninit_driver();
+	host_set_driver_settings("it87", NULL);
+	emulated_bus_install(NULL);
+
+	char path[] = "/tmp/it87_traceXXXXXX";
+	int fd = mkstemp(path);
+	CHECK(fd >= 0);
+	FILE* file = fdopen(fd, "wb");
+	CHECK_EQUAL(fwrite(&ops[0], sizeof(it87_port_op), ops.size(), file), ops.size());
+	fclose(file);
+
+	std::vector<it87_port_op> loaded;
+	CHECK_EQUAL(replay_load_trace(path, loaded), B_OK);
+	CHECK_EQUAL(loaded.size(), ops.size());
+	CHECK(loaded.size() == ops.size()
+		&& memcmp(&loaded[0], &ops[0], ops.size() * sizeof(it87_port_op)) == 0);
+
+	// Without the chip.
+	replay_bus replay;
+	replay_bus_init(&replay, &loaded[0], loaded.size());
+	replay_bus_install(&replay);
+	CHECK_EQUAL(init_driver(), B_OK);
+
+	// Only the probe on 0x4E, for a chip never recorded, reads unknown registers.
+	uint32 unknown = replay.unknown;
+	CHECK(unknown > 0);
+	const char** names = publish_devices();
+	CHECK(names[0] != NULL && strcmp(names[0], name) == 0 && names[2] == NULL);
+
+	cookie = open_device(name);
+	it87_sensors_sample sample;
+	// Refreshes play back the values of each sensor in turn, until there are no
+	// more left. Those of registers only read on the way to idle and back stay.
+	uint32 replayed;
+	do {
+		replayed = replay.replayed;
+		control_device(name, cookie, IT87_SENSORS_REFRESH, &sample, sizeof(sample));
+	} while (replay.replayed > replayed);
+	CHECK(replay.recorded - replay.replayed < 10);
+	CHECK(same_data(sample.data, samples[3].data));
+	CHECK_EQUAL(replay.unknown, unknown);
+
+	close_device(name, cookie);
+	uninit_driver();
+	replay_bus_install(NULL);
+
+	// Anything but whole ops isn't a trace.
+	file = fopen(path, "ab");
+	fputc(0, file);
+	fclose(file);
+	loaded.clear();
+	CHECK_EQUAL(replay_load_trace(path, loaded), B_BAD_VALUE);
+	unlink(path);
+}
+
+
+int
+main()
+{
+	test_probe_and_refresh(0x8718, 0x2E);
+	test_probe_and_refresh(0x8705, 0x4E);
+	test_probe_and_refresh(0x8625, 0x2E);
+	test_driver_trace();
+
+	return test_result("test_replay");
+}
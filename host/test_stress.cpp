@@ -0,0 +1,236 @@
+//
+// Copyright 2003-2006, 2022-2023, Oscar Lesta. All right reserved.
+// Distributed under the terms of the MIT License.
+//
+// Dozens of threads opening, reading, poking and closing the device at once.
+// The simulated chip moves all of its inputs to a new "generation" whenever a
+// refresh starts (on the VIN0 select), so every sample anyone gets to see has
+// to match one generation as a whole: anything else is a torn copy, or
+// registers from different refreshes mixed up.
+//
+
+#include "test.h"
+
+#include <KernelExport.h>
+
+#include <set>
+#include <string>
+
+#include "../it87_regs.h"
+
+
+static const char* kDevice = "sensor/it87/0";
+static const int kGenerations = 256;
+static const bigtime_t kRoundTime = 200000;
+
+// What each generation reads as, indexed by the VIN0 register, which alone
+// tells generations apart. Filled in single threaded before the stress.
+static it87_sensors_data sExpected[kGenerations];
+static bool sSeen[kGenerations];
+static std::set<std::string> sExpectedText;
+
+static int32 sGeneration;
+static const it87_sensors_shared* sShared;
+static int32 sStop;
+
+
+static void
+set_generation(emulated_chip* chip, int32 generation)
+{
+	for (int i = 0; i < 9; i++)
+		chip->inputs[IT87_REG_VIN0 + i] = (generation * 3 + i * 11) & 0xff;
+	for (int i = 0; i < 3; i++)
+		chip->inputs[IT87_REG_TEMP0 + i] = (generation * 3 + (9 + i) * 11) & 0xff;
+
+	// Kept where 16-bit counts still give distinct RPMs.
+	for (int fan = 0; fan < chip->fan_count; fan++)
+		emulated_chip_set_fan(chip, fan, 300 + ((generation * 3 + (12 + fan) * 11) & 0xff));
+}
+
+
+static void
+next_generation(emulated_chip* chip, uint8 reg, void* cookie)
+{
+	// Only refreshes select VIN0, and always first, with hardware_lock held.
+	if (reg != IT87_REG_VIN0)
+		return;
+
+	sGeneration = (sGeneration + 1) % kGenerations;
+	set_generation(chip, sGeneration);
+}
+
+
+static bool
+is_whole(const it87_sensors_data& data)
+{
+	int index = data.voltages[0] / 16;
+	return index >= 0 && index < kGenerations && sSeen[index]
+		&& memcmp(&data, &sExpected[index], sizeof(it87_sensors_data)) == 0;
+}
+
+
+struct worker_stats {
+	int64	calls;
+	int64	bad_samples;
+};
+
+
+static status_t
+stress_thread(void* data)
+{
+	worker_stats& stats = *(worker_stats*)data;
+	device_hooks* hooks = find_device(kDevice);
+	char text[1024];
+
+	while (atomic_get(&sStop) == 0) {
+		void* cookie = open_device(kDevice);
+		stats.calls++;
+
+		for (int i = 0; i < 4; i++) {
+			size_t length = sizeof(text);
+			if (hooks->read(cookie, 0, text, &length) != B_OK
+				|| sExpectedText.count(std::string(text, length)) == 0)
+				stats.bad_samples++;
+
+			it87_sensors_data data;
+			if (control_device(kDevice, cookie, IT87_SENSORS_READ, &data, sizeof(data))
+					!= B_OK || !is_whole(data))
+				stats.bad_samples++;
+
+			it87_sensors_sample sample;
+			if (control_device(kDevice, cookie, IT87_SENSORS_REFRESH, &sample,
+					sizeof(sample)) != B_OK || !is_whole(sample.data))
+				stats.bad_samples++;
+
+			it87_sensors_sample samples[8];
+			it87_sensors_history history = { sample.sequence - 8, 8, samples };
+			if (control_device(kDevice, cookie, IT87_SENSORS_READ_HISTORY, &history,
+					sizeof(history)) != B_OK)
+				stats.bad_samples++;
+			for (uint32 j = 0; j < history.count; j++) {
+				if (!is_whole(samples[j].data)
+					|| (j > 0 && samples[j].sequence - samples[j - 1].sequence <= 0))
+					stats.bad_samples++;
+			}
+
+			it87_read_shared(sShared, &sample);
+			if (!is_whole(sample.data))
+				stats.bad_samples++;
+
+			stats.calls += 5;
+		}
+
+		close_device(kDevice, cookie);
+		stats.calls++;
+	}
+
+	return B_OK;
+}
+
+
+static void
+stress(void* cookie, int32 threadCount)
+{
+	control_device(kDevice, cookie, IT87_SENSORS_RESET_STATS, NULL, 0);
+
+	std::vector<worker_stats> workers(threadCount);
+	std::vector<thread_id> threads(threadCount);
+	atomic_set(&sStop, 0);
+
+	bigtime_t start = system_time();
+	for (int32 i = 0; i < threadCount; i++) {
+		workers[i].calls = workers[i].bad_samples = 0;
+		threads[i] = spawn_kernel_thread(stress_thread, "stress", B_NORMAL_PRIORITY,
+			&workers[i]);
+		resume_thread(threads[i]);
+	}
+
+	snooze(kRoundTime);
+	atomic_set(&sStop, 1);
+
+	status_t result;
+	for (int32 i = 0; i < threadCount; i++)
+		wait_for_thread(threads[i], &result);
+	bigtime_t elapsed = system_time() - start;
+
+	int64 calls = 0;
+	int64 badSamples = 0;
+	for (int32 i = 0; i < threadCount; i++) {
+		calls += workers[i].calls;
+		badSamples += workers[i].bad_samples;
+	}
+
+	it87_sensors_stats stats;
+	control_device(kDevice, cookie, IT87_SENSORS_GET_STATS, &stats, sizeof(stats));
+	printf("%3" B_PRId32 " threads: %9.0f calls/s, %8" B_PRId64 " refreshes (%" B_PRId64
+		" coalesced), lock wait: hardware %6.2f µs/call (%" B_PRId64 " contended), "
+		"refresh %6.2f µs/call (%" B_PRId64 " contended)\n", threadCount,
+		calls * 1000000.0 / elapsed, stats.refreshes, stats.coalesced_refreshes,
+		(double)stats.hardware_lock_wait / calls, stats.hardware_lock_contended,
+		(double)stats.refresh_lock_wait / calls, stats.refresh_lock_contended);
+
+	CHECK_EQUAL(badSamples, 0);
+	CHECK_EQUAL(stats.over_budget_refreshes, 0);
+}
+
+
+int
+main()
+{
+	emulated_bus bus;
+	emulated_bus_init(&bus);
+	emulated_chip chip;
+	setup_chip(&bus, &chip, 0x8718, 0x2E, 0x290);
+	set_generation(&chip, 0);
+	chip.select_hook = next_generation;
+	emulated_bus_install(&bus);
+
+	// Only requests refresh, so a single thread can see every generation
+	// before the stress starts.
+	host_set_driver_settings("it87", "adaptive_sampling false\nsample_period 60000\n");
+	CHECK_EQUAL(init_driver(), B_OK);
+	void* cookie = open_device(kDevice);
+
+	char text[1024];
+	for (int i = 0; i < kGenerations * 2; i++) {
+		it87_sensors_sample sample;
+		control_device(kDevice, cookie, IT87_SENSORS_REFRESH, &sample, sizeof(sample));
+		int index = sample.data.voltages[0] / 16;
+		sExpected[index] = sample.data;
+		sSeen[index] = true;
+
+		size_t length = sizeof(text);
+		find_device(kDevice)->read(cookie, 0, text, &length);
+		sExpectedText.insert(std::string(text, length));
+	}
+	CHECK_EQUAL((int)sExpectedText.size(), kGenerations);
+
+	area_id area;
+	control_device(kDevice, cookie, IT87_SENSORS_GET_AREA, &area, sizeof(area));
+	area_id clone = clone_area("it87 shared", (void**)&sShared, B_ANY_ADDRESS,
+		B_READ_AREA, area);
+	CHECK(clone >= 0);
+
+	// The counter and each buffer on cache lines of their own.
+	uintptr_t sequenceLine = (uintptr_t)&sShared->sequence / IT87_CACHE_LINE_SIZE;
+	uintptr_t firstLine = (uintptr_t)&sShared->buffers[0] / IT87_CACHE_LINE_SIZE;
+	uintptr_t lastLine = ((uintptr_t)&sShared->buffers[0] + sizeof(it87_sensors_sample) - 1)
+		/ IT87_CACHE_LINE_SIZE;
+	CHECK(firstLine > sequenceLine);
+	CHECK((uintptr_t)&sShared->buffers[1] / IT87_CACHE_LINE_SIZE > lastLine);
+
+	// Slow enough for refreshes to overlap with everything else.
+	bus.latency = 200;
+
+	for (int32 threads = 1; threads <= 64; threads *= 2)
+		stress(cookie, threads);
+
+	bus.latency = 0;
+	delete_area(clone);
+	close_device(kDevice, cookie);
+	uninit_driver();
+	host_set_driver_settings("it87", NULL);
+	emulated_bus_install(NULL);
+
+	return test_result("test_stress");
+}
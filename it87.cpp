@@ -9,483 +9,2043 @@
 #include <Errors.h>
 #include <ISA.h>
 #include <KernelExport.h>	// for spin(bigtime_t µsecs)
+#include <driver_settings.h>
 
+#include <stddef.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "it87_regs.h"
 #include "it87.h"
+#include "it87_core.h"
 
 //-----------------------------------------------------------------------------
 
-#define TRACE_IT87
-#ifdef TRACE_IT87
-#	define TRACE(x...) dprintf("it87: " x)
-#else
-#	define TRACE(x...)
-#endif
-#define INFO(x...)	dprintf("it87: " x)
-#define ERROR(x...)	dprintf("it87: " x)
-
 #define IT87_SENSOR_DEVICE_NAME		"it87"
+#define IT87_RAW_DEVICE_NAME		"it87_raw"
+
+// Super I/O config ports probed, one chip each at most.
+static const uint16 kConfigPorts[] = { 0x2E, 0x4E };
+#define IT87_MAX_DEVICES	(sizeof(kConfigPorts) / sizeof(kConfigPorts[0]))
 
-#define IT87_ADDRESS_REG	(gBaseAddress + IT87_ADDR_PORT_OFFSET)
-#define IT87_DATA_REG		(gBaseAddress + IT87_DATA_PORT_OFFSET)
 
 //-----------------------------------------------------------------------------
 // Globals
 
 int32 api_version = B_CUR_DRIVER_API_VERSION;
 
-static isa_module_info* gISA;
+// Text rendering of each it87_device::shared buffer, done once per sample by
+// the sampler, and guarded by the same sequence counter.
+// 17*9 + 16*3 + 16*5 = 281 bytes for volts, temps ("°" takes 2 bytes), and fans,
+// respectively. Plus some room for negative voltages and 5 digits RPMs.
+#define IT87_TEXT_SIZE	384
+
+// Padded to whole cache lines, like the it87_sensors_shared buffers.
+struct rendered_text {
+	size_t	length;
+	char	text[IT87_TEXT_SIZE];
+} __attribute__((aligned(IT87_CACHE_LINE_SIZE)));
+
+// select()ers get notified on the next publish.
+#define IT87_MAX_SELECTS	16
+
+struct select_entry {
+	selectsync*	sync;
+	uint8		event;
+};
+
+// In-kernel consumers, see it87_sensors_module_info.
+#define IT87_MAX_LISTENERS	8
+
+struct listener_entry {
+	it87_sensors_listener	function;
+	void*					cookie;
+};
+
+struct it87_cookie;
+
+// One per Super I/O chip found, published as "sensor/it87/<index>". Each one
+// has its own locks and sampler thread, so chips get sampled concurrently.
+struct it87_device : it87_chip {
+	int32				index;
+
+	// Last sample taken by the sampler thread. All readers are served from here,
+	// including userland ones that cloned the area.
+	//
+	// Double-buffered, and guarded by a sequence counter instead of a lock (see
+	// it87_read_shared()). Readers never block, they retry only if the buffer they
+	// were copying got recycled under their feet.
+	it87_sensors_shared* shared;
+	area_id				shared_area;
+	rendered_text		text[2];
+
+	// The last IT87_HISTORY_SIZE samples, indexed by sequence number (see
+	// history_slot()).
+	it87_sensors_sample	history[IT87_HISTORY_SIZE];
+	it87_sensors_raw	raw_history[IT87_HISTORY_SIZE];	// same slots as history.
+	int32				history_newest;
+	uint32				history_count;	// up to IT87_HISTORY_SIZE.
+	sem_id				history_lock;
+
+	// IT87_SENSORS_WAIT callers (and blocking binary and raw reads) check for a
+	// new sample holding wait_lock, and block on publish_sem letting go of it
+	// in the same step, see wait_for_sample(). Each publish wakes up all of
+	// them at once, leaving no counts behind.
+	sem_id				wait_lock;
+	sem_id				publish_sem;
+	int32				waiters;		// in wait_for_sample() right now.
+
+	select_entry		selects[IT87_MAX_SELECTS];
+	sem_id				select_lock;
+
+	listener_entry		listeners[IT87_MAX_LISTENERS];
+	sem_id				listener_lock;
+
+	// Reading the interrupt status registers clears them, so whatever the
+	// sampler sees is kept here until IT87_SENSORS_GET_ALARMS picks it up.
+	int32				limits_armed;
+	int32				latched_alarms;
+
+	// Serializes access to the EC index/data ports.
+	sem_id				hardware_lock;
+
+	// Only one sample gets taken (and published) at a time. See refresh_snapshot().
+	sem_id				refresh_lock;
+
+	// The sampler (and the EC monitoring) only runs while the device is open
+	// (or the module is in use).
+	int32				open_count;
+	sem_id				open_lock;
+	it87_cookie*		cookies;		// all open ones, protected by open_lock.
+
+	thread_id			sampler_thread;
+	sem_id				sampler_sem;	// deleted to make the sampler thread quit.
+	bigtime_t			default_period;	// from settings.
+	bigtime_t			sample_period;	// what clients asked for.
+
+	// With adaptive sampling, each channel group gets sampled every
+	// group_periods[] µs: min_period while its values move, backing off up to
+	// sample_period while they don't. See it87_sampler().
+	bool				adaptive;
+	bigtime_t			min_period;		// from settings.
+	bigtime_t			max_period;		// from settings.
+	bigtime_t			group_periods[IT87_GROUP_COUNT];
+	uint32				group_channels[IT87_GROUP_COUNT];
+
+	uint32				refreshed_channels;	// by the last refresh, under refresh_lock.
+
+	// Sampling stops after idle_timeout µs without requests, unless someone
+	// might be reading without asking: module users ("pinned"), clients with
+	// the area cloned, waiters and select()ers. See note_request().
+	bigtime_t			idle_timeout;	// 0 to sample for as long as it's open.
+	bigtime_t			last_request;
+	int32				idle;
+	int32				pinned;
+	int32				area_users;
+};
+
+static it87_device gDevices[IT87_MAX_DEVICES];
+static int32 gDeviceCount = 0;
+
+// Both the driver and the module interface set up (and tear down) the devices,
+// whichever comes first (or goes last). See init_devices().
+static int32 gInitCount = 0;
+static int32 gInitLock = 0;
 
-static uint16 gChipID = 0;
-static uint16 gBaseAddress = 0;	// default ISA base address 0x290
 
 //-----------------------------------------------------------------------------
-//	#pragma mark - Hardware I/O
+//	#pragma mark - Locking
 
-static inline uint8
-read_indexed(uint16 port, uint8 reg)
+// acquire_sem(), accounting for the time spent blocked, if any.
+static void
+acquire_accounted(sem_id sem, int64* contended, bigtime_t* wait)
 {
-	gISA->write_io_8(port, reg);
-	return gISA->read_io_8(port + 1);
+	if (acquire_sem_etc(sem, 1, B_RELATIVE_TIMEOUT, 0) == B_OK)
+		return;
+
+	bigtime_t start = system_time();
+	acquire_sem(sem);
+	atomic_add64(contended, 1);
+	atomic_add64(wait, system_time() - start);
 }
 
 
 static inline void
-write_indexed(uint16 port, uint8 reg, uint8 value)
+lock_hardware(it87_device* device)
 {
-	gISA->write_io_8(port, reg);
-	gISA->write_io_8(port + 1, value);
+	acquire_accounted(device->hardware_lock, &device->stats.hardware_lock_contended,
+		&device->stats.hardware_lock_wait);
 }
 
 
 static inline void
-enter_mb_pnp_mode(void)
+lock_refresh(it87_device* device)
 {
-	// Write 0x87, 0x01, 0x55, 0x55 to register 0x2E to enter MB PnP Mode.
-	gISA->write_io_8(0x2E, 0x87);
-	gISA->write_io_8(0x2E, 0x01);
-	gISA->write_io_8(0x2E, 0x55);
-	gISA->write_io_8(0x2E, 0x55);
+	acquire_accounted(device->refresh_lock, &device->stats.refresh_lock_contended,
+		&device->stats.refresh_lock_wait);
 }
 
 
-static inline void
-exit_mb_pnp_mode(void)
+//-----------------------------------------------------------------------------
+//	#pragma mark - Limits and Alarms
+
+// Programs the limits asked for, and from then on lets the sampler check the
+// alarms too.
+static void
+arm_limits(it87_device* device, it87_sensors_limits& limits)
 {
-	//---- Set bit 1 to 1 in register at index 0x2 to leave MB PnP Mode.
-	// Return to the "Wait for Key" state after we're done with the config.
-	write_indexed(0x2E, 0x02, read_indexed(0x2E, 0x02) | (1 << 1));
+	lock_hardware(device);
+	limits.valid = it87_set_limits(device, limits);
+	release_sem(device->hardware_lock);
+
+	if (limits.valid != 0)
+		atomic_set(&device->limits_armed, 1);
 }
 
 
-static uint16
-it87xx_detect(void)
+//-----------------------------------------------------------------------------
+//	#pragma mark - Stats
+
+static inline int64
+port_ops(it87_device* device)
 {
-	uint16 result = 0x0000; // Return this if we don't find a supported ITE chip.
+	return atomic_get64(&device->stats.port_reads)
+		+ atomic_get64(&device->stats.port_writes);
+}
 
-	enter_mb_pnp_mode();
 
-	uint16 chip_id = (read_indexed(0x2E, 0x20) << 8) | read_indexed(0x2E, 0x21);
-	switch (chip_id) {
-		case 0x8625:
-		case 0x8628:
-		case 0x8655:
+static void
+account_refresh(it87_device* device, bigtime_t latency, int64 portOps, int32 budget)
+{
+	atomic_add64(&device->stats.refreshes, 1);
+	atomic_add64(&device->stats.total_latency, latency);
+
+	atomic_set64(&device->stats.refresh_port_ops, portOps);
+	if (portOps > budget) {
+		atomic_add64(&device->stats.over_budget_refreshes, 1);
+		TRACE("refresh took %" B_PRId64 " port accesses, %" B_PRId32 " expected.\n",
+			portOps, budget);
+	}
 
-		case 0x8705:
-		case 0x8712:
-		case 0x8718:
-		case 0x8720:
-		case 0x8721:
-		case 0x8726:
-		case 0x8728:
-		case 0x8771:
-		case 0x8772:
-			result = chip_id;	// an ITE IT87xx was found.
+	int bucket = 0;
+	while (bucket < IT87_LATENCY_BUCKETS - 1 && (latency >> (bucket + 1)) != 0)
+		bucket++;
+	atomic_add64(&device->stats.latency_histogram[bucket], 1);
+
+	bigtime_t max = atomic_get64(&device->stats.max_latency);
+	while (latency > max) {
+		bigtime_t previous = atomic_test_and_set64(&device->stats.max_latency, latency, max);
+		if (previous == max)
+			break;
+		max = previous;
 	}
+}
 
-	exit_mb_pnp_mode();
 
-	return result;
+static void
+reset_stats(it87_device* device)
+{
+	// it87_sensors_stats is made of int64s only.
+	int64* fields = (int64*)&device->stats;
+	for (size_t i = 0; i < sizeof(it87_sensors_stats) / sizeof(int64); i++)
+		atomic_set64(&fields[i], 0);
 }
 
 
-static uint16
-find_isa_port_address(void)
+static void
+read_stats(it87_device* device, it87_sensors_stats& stats)
 {
-	uint16 port = 0;
+	int64* fields = (int64*)&device->stats;
+	int64* copy = (int64*)&stats;
+	for (size_t i = 0; i < sizeof(it87_sensors_stats) / sizeof(int64); i++)
+		copy[i] = atomic_get64(&fields[i]);
+
+	stats.refresh_port_budget = device->refresh_port_budget;
+	for (int group = 0; group < IT87_GROUP_COUNT; group++)
+		stats.group_periods[group] = atomic_get64(&device->group_periods[group]);
+}
+
+
+//-----------------------------------------------------------------------------
+//	#pragma mark - Sampler
 
-	enter_mb_pnp_mode();
+static void
+notify_selects(it87_device* device)
+{
+	acquire_sem(device->select_lock);
+	for (int i = 0; i < IT87_MAX_SELECTS; i++) {
+		if (device->selects[i].sync != NULL) {
+			notify_select_event(device->selects[i].sync, device->selects[i].event);
+			device->selects[i].sync = NULL;	// one notification per select() is enough.
+		}
+	}
+	release_sem(device->select_lock);
+}
 
-	// Select the proper logical device: LDN 0x4 = Enviromental Controller (EC).
-	write_indexed(0x2E, 0x07, 0x4);
 
-	// Make sure the EC is active.
-	write_indexed(0x2E, 0x30, 0x1);
+static void
+notify_listeners(it87_device* device, const it87_sensors_sample& sample)
+{
+	acquire_sem(device->listener_lock);
+	for (int i = 0; i < IT87_MAX_LISTENERS; i++) {
+		const listener_entry& listener = device->listeners[i];
+		if (listener.function != NULL)
+			listener.function(listener.cookie, device->index, &sample);
+	}
+	release_sem(device->listener_lock);
+}
 
-	// Now fetch the base address port.
-	port = read_indexed(0x2E, 0x60) << 8;
-	port |= read_indexed(0x2E, 0x61);
 
-	exit_mb_pnp_mode();
-	return port;
+// Sequence numbers wrap around, so they're compared by distance: "sequence" is
+// newer than "other" if it's less than half the range ahead of it.
+static inline bool
+is_newer(int32 sequence, int32 other)
+{
+	return (int32)((uint32)sequence - (uint32)other) > 0;
 }
 
-/*
-int set_bit(int n, int k)
+
+// The one after "sequence". Skips 0 and -1 when wrapping around, they mean
+// "none" and "the last one delivered" to IT87_SENSORS_WAIT.
+static inline int32
+next_sequence(int32 sequence)
 {
-	return (n | (1 << k));
+	sequence = (int32)((uint32)sequence + 1);
+	return sequence == -1 ? 1 : sequence;
 }
 
 
-int clear_bit(int n, int k)
+static inline uint32
+history_slot(int32 sequence)
 {
-	return (n & (~(1 << k)));
+	return (uint32)sequence & (IT87_HISTORY_SIZE - 1);
 }
 
 
-int toggle_bit(int n, int k)
+static void
+publish_snapshot(it87_device* device, const it87_sensors_sample& sample,
+	const it87_sensors_raw& raw)
 {
-	return (n ^ (1 << k));
+	// Needs refresh_lock, so there's only one writer at a time.
+	int32 sequence = atomic_add(&device->shared->sequence, 1);	// odd: writing.
+
+	int index = ((sequence >> 1) + 1) & 1;
+	it87_sensors_sample& buffer = device->shared->buffers[index].sample;
+	buffer = sample;
+	buffer.sequence = next_sequence(device->history_newest);
+
+	device->text[index].length = it87_render_text(device, sample.data,
+		device->text[index].text, IT87_TEXT_SIZE);
+
+	atomic_add(&device->shared->sequence, 1);	// even: published.
+
+	acquire_sem(device->history_lock);
+	device->history[history_slot(buffer.sequence)] = buffer;
+	device->raw_history[history_slot(buffer.sequence)] = raw;
+	device->history_newest = buffer.sequence;
+	if (device->history_count < IT87_HISTORY_SIZE)
+		device->history_count++;
+	release_sem(device->history_lock);
+
+	if (atomic_get(&device->waiters) > 0) {
+		acquire_sem(device->wait_lock);
+		release_sem_etc(device->publish_sem, 0, B_RELEASE_ALL | B_DO_NOT_RESCHEDULE);
+		release_sem(device->wait_lock);
+	}
+
+	notify_selects(device);
+	notify_listeners(device, buffer);
 }
-*/
+
 
 static inline void
-it87_config(bool enable)
+account_snapshot_read(it87_device* device, int32 retries)
 {
-	uint8 value = read_indexed(gBaseAddress, IT87_REG_CONFIG);
-	if (enable) {
-		value |= (1 << 6); // Update VBAT
-		value |= (1 << 0); // Start Monitoring Operations
-	} else {
-		value &= ~(1 << 6); // Don't update VBAT
-		value &= ~(1 << 0); // Stop Monitoring Operations
+	atomic_add64(&device->stats.snapshot_reads, 1);
+	if (retries > 0)
+		atomic_add64(&device->stats.snapshot_retries, retries);
+}
+
+
+static int32
+read_snapshot(it87_device* device, it87_sensors_sample& sample)
+{
+	account_snapshot_read(device, it87_read_shared(device->shared, &sample));
+	return sample.sequence;
+}
+
+
+// Same protocol as it87_read_shared(). "text" must hold IT87_TEXT_SIZE bytes.
+static size_t
+read_text(it87_device* device, char* text, int32& textSequence)
+{
+	for (int32 retries = 0; ; retries++) {
+		int32 sequence = atomic_get(&device->shared->sequence);
+
+		int index = (sequence >> 1) & 1;
+		const rendered_text& rendered = device->text[index];
+		size_t length = rendered.length;
+		if (length > IT87_TEXT_SIZE)
+			length = IT87_TEXT_SIZE;	// torn read, will retry.
+		memcpy(text, rendered.text, length);
+		textSequence = device->shared->buffers[index].sample.sequence;
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+		if ((uint32)atomic_get(&device->shared->sequence) - (uint32)(sequence & ~1) < 3) {
+			account_snapshot_read(device, retries);
+			return length;
+		}
 	}
-	write_indexed(gBaseAddress, IT87_REG_CONFIG, value);
 }
 
 
-//-----------------------------------------------------------------------------
-//	#pragma mark - Misc
+static inline int32
+current_sequence(it87_device* device)
+{
+	it87_sensors_sample sample;
+	return read_snapshot(device, sample);
+}
 
-static inline uint8
-ITESensorRead(int regNum)
+
+// Finds the oldest sample kept that's newer than "sequence" (0 for none), and
+// returns how many sequence numbers there are from it to the newest one. Needs
+// history_lock.
+static uint32
+history_after(it87_device* device, int32 sequence, int32& first)
 {
-	gISA->write_io_8(IT87_ADDRESS_REG, regNum);
-	return gISA->read_io_8(IT87_DATA_REG);
+	int32 newest = device->history_newest;
+	uint32 available = device->history_count;
+	if (sequence != 0) {
+		if (!is_newer(newest, sequence))
+			return 0;
+		if ((uint32)newest - (uint32)sequence < available)
+			available = (uint32)newest - (uint32)sequence;
+	}
+
+	// Older samples than the window have been overwritten already.
+	first = (int32)((uint32)newest - available + 1);
+	return available;
 }
 
 
-static inline void
-ITESensorWrite(int regNum, uint8 value)
+// Copies out the samples newer than history.sequence, oldest first, as many as fit.
+static status_t
+read_history(it87_device* device, it87_sensors_history& history)
 {
-	gISA->write_io_8(IT87_ADDRESS_REG, regNum);
-	gISA->write_io_8(IT87_DATA_REG, value);
+	if (history.count == 0)
+		return B_OK;
+
+	uint32 count = history.count;
+	if (count > IT87_HISTORY_SIZE)
+		count = IT87_HISTORY_SIZE;
+
+	it87_sensors_sample* samples
+		= (it87_sensors_sample*)malloc(count * sizeof(it87_sensors_sample));
+	if (samples == NULL)
+		return B_NO_MEMORY;
+
+	acquire_sem(device->history_lock);
+
+	int32 first;
+	uint32 available = history_after(device, history.sequence, first);
+
+	uint32 copied = 0;
+	for (uint32 i = 0; i < available && copied < count; i++) {
+		int32 sequence = (int32)((uint32)first + i);
+		const it87_sensors_sample& sample = device->history[history_slot(sequence)];
+		if (sample.sequence == sequence)	// not one of the numbers skipped.
+			samples[copied++] = sample;
+	}
+	count = copied;
+
+	release_sem(device->history_lock);
+
+	status_t status = B_OK;
+	if (count > 0
+		&& user_memcpy(history.samples, samples, count * sizeof(it87_sensors_sample)) != B_OK)
+		status = B_BAD_ADDRESS;
+
+	free(samples);
+
+	history.count = count;
+	return status;
 }
 
-/*
-static inline uint8
-ITESensorReadValue(int regNum)
+
+// Copies out the port accesses recorded since the last call, oldest first, as
+// many as fit.
+static status_t
+read_trace(it87_device* device, it87_sensors_trace& trace)
 {
-	while (gISA->read_io_8(IT87_ADDRESS_REG) & IT87_BUSY) {
-		spin(IT87_WAIT);
+	uint32 count = trace.count;
+	if (count > IT87_TRACE_SIZE)
+		count = IT87_TRACE_SIZE;
+
+	it87_port_op* ops = NULL;
+	if (count > 0) {
+		ops = (it87_port_op*)malloc(count * sizeof(it87_port_op));
+		if (ops == NULL)
+			return B_NO_MEMORY;
 	}
-	return ITESensorRead(regNum);
+
+	lock_hardware(device);
+	count = it87_read_trace(device, ops, count, trace.dropped);
+	release_sem(device->hardware_lock);
+
+	status_t status = B_OK;
+	if (count > 0 && user_memcpy(trace.ops, ops, count * sizeof(it87_port_op)) != B_OK)
+		status = B_BAD_ADDRESS;
+
+	free(ops);
+
+	trace.count = count;
+	return status;
 }
-*/
 
-//-----------------------------------------------------------------------------
-//	#pragma mark - utils funcs
 
-static inline int
-TwosComplement(uint8 value)
+// Fills "records" with the samples newer than "sequence", oldest first. Returns
+// how many were copied.
+static uint32
+read_raw_records(it87_device* device, int32 sequence, it87_sensors_raw_record* records,
+	uint32 count)
 {
-	return (value & 1 << 7) ? (~(unsigned)value) + 1 : value;
+	acquire_sem(device->history_lock);
+
+	int32 first;
+	uint32 available = history_after(device, sequence, first);
+
+	uint32 copied = 0;
+	for (uint32 i = 0; i < available && copied < count; i++) {
+		int32 expected = (int32)((uint32)first + i);
+		uint32 slot = history_slot(expected);
+		if (device->history[slot].sequence != expected)
+			continue;	// one of the numbers skipped.
+
+		records[copied].sequence = expected;
+		records[copied].timestamp = device->history[slot].timestamp;
+		records[copied].raw = device->raw_history[slot];
+		copied++;
+	}
+
+	release_sem(device->history_lock);
+
+	return copied;
 }
 
 
-static inline int
-CountToRPM(uint8 count)
+// Waits for a sample newer than "lastSequence" (and with alarms, if
+// IT87_WAIT_FOR_ALARMS is set in "flags").
+static status_t
+wait_for_sample(it87_device* device, int32 lastSequence, uint32 flags, bigtime_t timeout,
+	it87_sensors_sample& sample)
 {
-	if (count == 255)
-		return 0;
-	if (count < 2)
-		count = 152;
-	return 1350000 / (count * 2);
+	bigtime_t deadline = B_INFINITE_TIMEOUT;
+	if (timeout != B_INFINITE_TIMEOUT)
+		deadline = system_time() + timeout;
+
+	while (true) {
+		// Counted before checking, so a publish in between can't miss us. And
+		// uncounted on every way out.
+		acquire_sem(device->wait_lock);
+		atomic_add(&device->waiters, 1);
+
+		int32 sequence = read_snapshot(device, sample);
+		if (sequence != lastSequence) {
+			if ((flags & IT87_WAIT_FOR_ALARMS) == 0 || sample.alarms != 0) {
+				atomic_add(&device->waiters, -1);
+				release_sem(device->wait_lock);
+				return B_OK;
+			}
+			lastSequence = sequence;
+		}
+
+		status_t status = switch_sem_etc(device->wait_lock, device->publish_sem, 1,
+			B_ABSOLUTE_TIMEOUT | B_CAN_INTERRUPT, deadline);
+		atomic_add(&device->waiters, -1);
+		if (status != B_OK)
+			return status;
+	}
 }
 
-static inline int
-Count16ToRPM(uint16 count)
+
+// Takes a new sample of "channels", timing how long the chip took to answer.
+static void
+take_sample(it87_device* device, it87_sensors_sample& sample, it87_sensors_raw& raw,
+	uint32 channels)
 {
-	if (count == 0 || count == 255 || count == 0xffff)
-		return 0;
-	return 675000 / count;
+	lock_hardware(device);
+
+	// Nobody else touches the ports while we hold hardware_lock, so the
+	// difference is all ours.
+	int64 startOps = port_ops(device);
+	bigtime_t start = system_time();
+	int32 budget;
+	if (channels == device->available_channels) {
+		device->info->refresh(device, sample.data, raw);
+		budget = device->refresh_port_budget;
+	} else {
+		it87_refresh_channels(device, sample.data, raw, channels);
+		budget = it87_port_budget(device, channels);
+	}
+	account_refresh(device, system_time() - start, port_ops(device) - startOps, budget);
+
+	sample.timestamp = start;
+
+	sample.alarms = 0;
+	if (atomic_get(&device->limits_armed) != 0) {
+		sample.alarms = it87_read_alarms(device);
+		atomic_or(&device->latched_alarms, sample.alarms);
+	}
+
+	release_sem(device->hardware_lock);
 }
 
 
+// Takes and publishes a new sample of "channels", the others keep the values
+// of the previous one. Needs refresh_lock.
 static void
-OutInt(void* buffer, size_t* length, const char format[], int value)
+refresh_locked(it87_device* device, uint32 channels)
+{
+	it87_sensors_sample sample = {};
+	it87_sensors_raw raw = {};
+	if (channels != device->available_channels) {
+		acquire_sem(device->history_lock);
+		if (device->history_count > 0) {
+			sample = device->history[history_slot(device->history_newest)];
+			raw = device->raw_history[history_slot(device->history_newest)];
+		}
+		release_sem(device->history_lock);
+	}
+
+	take_sample(device, sample, raw, channels);
+	device->refreshed_channels = channels;
+	publish_snapshot(device, sample, raw);
+}
+
+
+// Takes and publishes a new sample. Single flight: whoever arrives while a
+// refresh is in progress waits for it and shares its result, instead of
+// sweeping the registers again. Returns the sequence of that sample.
+//
+// Channels not in "channels" keep the values of the previous sample.
+static int32
+refresh_snapshot(it87_device* device, uint32 channels = ~(uint32)0)
+{
+	channels &= device->available_channels;
+	int32 seen = current_sequence(device);
+
+	lock_refresh(device);
+
+	int32 sequence = current_sequence(device);
+	if (sequence != seen && (device->refreshed_channels & channels) == channels) {
+		// Published while we were waiting.
+		release_sem(device->refresh_lock);
+		atomic_add64(&device->stats.coalesced_refreshes, 1);
+		return sequence;
+	}
+
+	refresh_locked(device, channels);
+	release_sem(device->refresh_lock);
+
+	return current_sequence(device);
+}
+
+
+// Shortest period a group can be sampled at, given the current "cap".
+static inline bigtime_t
+group_min_period(it87_device* device, bigtime_t cap)
+{
+	return device->adaptive && device->min_period < cap ? device->min_period : cap;
+}
+
+
+// Whether a channel changed enough between two samples for its group to be
+// sampled as often as allowed. Roughly a couple of ADC steps for voltages,
+// which go through dividers of different ratios.
+static bool
+has_moved(const sensor_desc& sensor, int16 before, int16 after)
 {
-	sprintf((char*) buffer + *length, format, value);
-	*length = strlen((char*) buffer);
+	int delta = after > before ? after - before : before - after;
+	int magnitude = before < 0 ? -before : before;
+
+	switch (sensor.kind) {
+		case SENSOR_VOLTAGE:
+			return delta * 50 > magnitude;	// 2%
+		case SENSOR_TEMP:
+			return delta >= 2;				// °C
+		case SENSOR_FAN:
+			return delta * 20 > magnitude;	// 5%
+	}
+
+	return false;
 }
 
 
 static void
-OutFloat(void* buffer, size_t* length, const char format[], uint value, uint scale)
+set_monitoring(it87_device* device, bool enable)
 {
-	char* str = (char*) buffer + *length;
-	sprintf(str, format, (value / scale), (value % scale));
-	*length = strlen((char*) buffer);
+	lock_hardware(device);
+	it87_config(device, enable);
+	release_sem(device->hardware_lock);
 }
 
 
+// Turns monitoring on, and waits for the ADC to go over every input: until
+// then, the value registers hold whatever they had when it was turned off.
 static void
-it87_refresh(it87_sensors_data& data)
-{
-	// IT87-compatible chips ADC are 8-bits, with a range of 0 to 4096 mV
-	// So... resolution is 16 mV.
-	// See "Table 4-1. Analog to Digital Table for Monitoring Voltage" on "IT8705F PG ec v03.pdf"
-	#define ADC_RES		16
-
-	enter_mb_pnp_mode();
-	it87_config(true);
-
-	data.voltages[0] = ITESensorRead(IT87_REG_VIN0) * ADC_RES;
-	data.voltages[1] = ITESensorRead(IT87_REG_VIN1) * ADC_RES;
-	data.voltages[2] = ITESensorRead(IT87_REG_VIN2) * ADC_RES;
-	data.voltages[3] = ITESensorRead(IT87_REG_VIN3) * ADC_RES * 1.68;	// +5V. (6854.4 mV / 255)
-	data.voltages[4] = ITESensorRead(IT87_REG_VIN4) * ADC_RES * 4; 	// +12V. (16320 mV / 255)
-	// This can either be -12V, or RAM Voltage
-	data.voltages[5] = ITESensorRead(IT87_REG_VIN5) * ADC_RES;
-	// This can either be -5V, or HT Voltage
-	data.voltages[6] = ITESensorRead(IT87_REG_VIN6) * ADC_RES;
-	data.voltages[7] = ITESensorRead(IT87_REG_VIN7) * ADC_RES * 1.68;	// +5V SB
-	data.voltages[8] = ITESensorRead(IT87_REG_VBAT) * ADC_RES;
-
-	data.temps[0] = TwosComplement(ITESensorRead(IT87_REG_TEMP0));
-	data.temps[1] = TwosComplement(ITESensorRead(IT87_REG_TEMP1));
-	data.temps[2] = TwosComplement(ITESensorRead(IT87_REG_TEMP2));
-
-	if (gChipID == 0x8705 || gChipID == 0x8712) {
-		// Older chips (8-bit tachometers):
-		data.fans[0] = CountToRPM(ITESensorRead(IT87_REG_FAN_1));
-		data.fans[1] = CountToRPM(ITESensorRead(IT87_REG_FAN_2));
-		data.fans[2] = CountToRPM(ITESensorRead(IT87_REG_FAN_3));
-	} else {
-		data.fans[0] = Count16ToRPM(
-			ITESensorRead(IT87_REG_FAN_1) | ITESensorRead(IT87_REG_FAN_1_EXT) << 8);
-		data.fans[1] = Count16ToRPM(
-			ITESensorRead(IT87_REG_FAN_2) | ITESensorRead(IT87_REG_FAN_2_EXT) << 8);
-		data.fans[2] = Count16ToRPM(
-			ITESensorRead(IT87_REG_FAN_3) | ITESensorRead(IT87_REG_FAN_3_EXT) << 8);
-		data.fans[3] = Count16ToRPM(
-			ITESensorRead(IT87_REG_FAN_4_LSB) | ITESensorRead(IT87_REG_FAN_4_MSB) << 8);
-		data.fans[4] = Count16ToRPM(
-			ITESensorRead(IT87_REG_FAN_5_LSB) | ITESensorRead(IT87_REG_FAN_5_MSB) << 8);
-	}
+start_monitoring(it87_device* device)
+{
+	set_monitoring(device, true);
+	snooze(IT87_CONVERSION_TIME * 1000LL);
+}
+
 
-	it87_config(false);
-	exit_mb_pnp_mode();
+// Whether it's been a while since the last request, and nobody could be reading
+// without making any.
+static bool
+nobody_reading(it87_device* device, bigtime_t now, bigtime_t lastRequest)
+{
+	if (device->idle_timeout <= 0 || now - lastRequest < device->idle_timeout
+		|| atomic_get(&device->pinned) > 0 || atomic_get(&device->area_users) > 0
+		|| atomic_get(&device->waiters) > 0)
+		return false;
+
+	bool selected = false;
+	acquire_sem(device->select_lock);
+	for (int i = 0; i < IT87_MAX_SELECTS && !selected; i++)
+		selected = device->selects[i].sync != NULL;
+	release_sem(device->select_lock);
+
+	return !selected;
 }
 
-//-----------------------------------------------------------------------------
-//	#pragma mark - Device Hooks
 
-static status_t
-device_open(const char name[], uint32 flags, void** cookie)
+// Stops sampling (and monitoring) until wake_sampler() gets called. Returns
+// false if the sampler should quit instead.
+static bool
+idle_sampler(it87_device* device, bigtime_t lastRequest)
 {
-	*cookie = NULL;
-	return B_OK;
+	// Flagged idle before monitoring goes off, and under refresh_lock: requests
+	// either came in before, and keep us going, or see the flag, and resume
+	// through wake_sampler(), which waits for the lock, and the ADC, before
+	// taking a fresh sample.
+	lock_refresh(device);
+	if (atomic_get64(&device->last_request) != lastRequest) {
+		release_sem(device->refresh_lock);
+		return true;
+	}
+
+	atomic_set(&device->idle, 1);
+	set_monitoring(device, false);
+	release_sem(device->refresh_lock);
+
+	atomic_add64(&device->stats.idle_stops, 1);
+	TRACE("no requests for a while, sampling stopped.\n");
+
+	// The period might change meanwhile, that's no reason to wake up.
+	while (atomic_get(&device->idle) != 0) {
+		if (acquire_sem(device->sampler_sem) != B_OK)
+			return false;
+	}
+
+	return true;
 }
 
 
+// Samples each channel group when it's due. Groups whose values moved since
+// the last time get sampled as often as allowed, the others back off.
 static status_t
-device_close(void* cookie)
+it87_sampler(void* _device)
 {
+	it87_device* device = (it87_device*)_device;
+
+	it87_sensors_sample last;
+	read_snapshot(device, last);
+
+	bigtime_t due[IT87_GROUP_COUNT];
+	for (int group = 0; group < IT87_GROUP_COUNT; group++)
+		due[group] = last.timestamp + device->group_periods[group];
+
+	while (true) {
+		bigtime_t wakeup = due[0];
+		for (int group = 1; group < IT87_GROUP_COUNT; group++) {
+			if (due[group] < wakeup)
+				wakeup = due[group];
+		}
+
+		// sampler_sem gets released when the period changes, and deleted when
+		// we should quit.
+		status_t status = acquire_sem_etc(device->sampler_sem, 1, B_ABSOLUTE_TIMEOUT,
+			wakeup);
+		if (status != B_TIMED_OUT && status != B_OK)
+			break;
+
+		bigtime_t now = system_time();
+		bigtime_t cap = atomic_get64(&device->sample_period);
+
+		if (status == B_OK) {
+			// Don't keep anyone waiting longer than they now asked for.
+			for (int group = 0; group < IT87_GROUP_COUNT; group++) {
+				if (device->group_periods[group] > cap)
+					atomic_set64(&device->group_periods[group], cap);
+				if (due[group] > now + cap)
+					due[group] = now + cap;
+			}
+			continue;
+		}
+
+		bigtime_t lastRequest = atomic_get64(&device->last_request);
+		if (nobody_reading(device, now, lastRequest)) {
+			if (!idle_sampler(device, lastRequest))
+				break;
+
+			// Whoever woke us up took a fresh sample already.
+			read_snapshot(device, last);
+			for (int group = 0; group < IT87_GROUP_COUNT; group++)
+				due[group] = last.timestamp + device->group_periods[group];
+			continue;
+		}
+
+		uint32 channels = 0;
+		for (int group = 0; group < IT87_GROUP_COUNT; group++) {
+			if (due[group] <= now)
+				channels |= device->group_channels[group];
+		}
+
+		refresh_snapshot(device, channels);
+
+		it87_sensors_sample sample;
+		read_snapshot(device, sample);
+
+		for (int group = 0; group < IT87_GROUP_COUNT; group++) {
+			if (due[group] > now)
+				continue;
+
+			bool moved = false;
+			for (int32 i = 0; i < device->active_count && !moved; i++) {
+				const sensor_desc& sensor = device->sensors[device->active_sensors[i]];
+				if (sensor.kind == group) {
+					moved = has_moved(sensor, sensor_value(last.data, sensor),
+						sensor_value(sample.data, sensor));
+				}
+			}
+
+			bigtime_t period = device->group_periods[group] * 2;
+			if (moved || period < group_min_period(device, cap))
+				period = group_min_period(device, cap);
+			if (period > cap)
+				period = cap;
+
+			atomic_set64(&device->group_periods[group], period);
+			due[group] = now + period;
+		}
+
+		last = sample;
+	}
+
 	return B_OK;
 }
 
 
-static status_t
-device_free(void* cookie)
+// Common resistor dividers, for the voltage scaling settings.
+static const struct {
+	const char*	name;
+	int16		num;
+	int16		den;
+	int16		offset;	// mV
+} kVoltagePresets[] = {
+	{ "none",	1,		1,		0 },
+	{ "+5V",	168,	100,	0 },		// 6.8K / 10K
+	{ "+12V",	4,		1,		0 },		// 30K / 10K
+	{ "-12V",	288,	56,		-16969 },	// (1 + 232/56) * Vin - 4.096 * 232/56
+	{ "-5V",	176,	56,		-8777 },	// (1 + 120/56) * Vin - 4.096 * 120/56
+};
+
+
+// Parses the scaling for a voltage channel, either a preset name, or
+// "numerator denominator [offset]". Ratios that would take the top ADC code
+// past what an int16 holds, at "adcResolution" µV, are refused.
+static void
+load_voltage_scaling(const driver_parameter& parameter, sensor_desc& sensor,
+	int32 adcResolution)
 {
-	return B_OK;
+	if (parameter.value_count == 1) {
+		for (size_t i = 0; i < sizeof(kVoltagePresets) / sizeof(kVoltagePresets[0]); i++) {
+			if (strcasecmp(parameter.values[0], kVoltagePresets[i].name) == 0) {
+				sensor.scale_num = kVoltagePresets[i].num;
+				sensor.scale_den = kVoltagePresets[i].den;
+				sensor.scale_offset = kVoltagePresets[i].offset;
+				return;
+			}
+		}
+	} else if (parameter.value_count >= 2) {
+		int32 num = strtol(parameter.values[0], NULL, 0);
+		int32 den = strtol(parameter.values[1], NULL, 0);
+		int32 offset = 0;
+		if (parameter.value_count >= 3)
+			offset = strtol(parameter.values[2], NULL, 0);
+
+		// The lowest code reads as "offset", and the highest as:
+		int64 top = 255LL * adcResolution * num / (den * 1000LL) + offset;
+
+		if (num > 0 && num <= INT16_MAX && den > 0 && den <= INT16_MAX
+			&& offset >= INT16_MIN && offset <= INT16_MAX && top <= INT16_MAX) {
+			sensor.scale_num = num;
+			sensor.scale_den = den;
+			sensor.scale_offset = offset;
+			return;
+		}
+	}
+
+	ERROR("invalid scaling for %s, ignored.\n", sensor.name);
 }
 
 
-static status_t
-device_control(void* cookie, uint32 operation, void* args, size_t length)
+static void
+load_channel_settings(it87_device* device, const driver_parameter* parameters,
+	int32 count)
 {
-	switch (operation) {
-		case IT87_SENSORS_READ:
-		{
-			it87_sensors_data data;
-			if (user_memcpy(&data, args, sizeof(it87_sensors_data)) != B_OK)
-				return B_BAD_ADDRESS;
+	for (int32 i = 0; i < count; i++) {
+		const driver_parameter& parameter = parameters[i];
+		for (int channel = IT87_CHANNEL_VIN0; channel <= IT87_CHANNEL_VBAT; channel++) {
+			if (strcasecmp(parameter.name, device->sensors[channel].name) == 0)
+				load_voltage_scaling(parameter, device->sensors[channel],
+					device->info->adc_resolution);
+		}
+	}
+}
 
-			it87_refresh(data);
 
-			if (user_memcpy(args, &data, sizeof(it87_sensors_data)) != B_OK)
-				return B_BAD_ADDRESS;
+// Periods are given in ms, and kept in µs.
+static void
+load_period(void* handle, const char* name, bigtime_t& period)
+{
+	const char* value = get_driver_parameter(handle, name, NULL, NULL);
+	if (value == NULL)
+		return;
+
+	int32 milliseconds = strtol(value, NULL, 0);
+	if (milliseconds < IT87_MIN_SAMPLE_PERIOD)
+		milliseconds = IT87_MIN_SAMPLE_PERIOD;
+	period = milliseconds * 1000LL;
+}
 
-			return B_OK;
+
+// Top level settings apply to every chip, "device <index> { ... }" blocks
+// only to that one.
+static void
+load_settings(it87_device* device)
+{
+	void* handle = load_driver_settings(IT87_SENSOR_DEVICE_NAME);
+	if (handle == NULL)
+		return;
+
+	const driver_settings* settings = get_driver_settings(handle);
+	if (settings != NULL)
+		load_channel_settings(device, settings->parameters, settings->parameter_count);
+
+	for (int32 i = 0; settings != NULL && i < settings->parameter_count; i++) {
+		const driver_parameter& parameter = settings->parameters[i];
+		if (strcasecmp(parameter.name, "device") == 0 && parameter.value_count > 0
+			&& strtol(parameter.values[0], NULL, 0) == device->index) {
+			load_channel_settings(device, parameter.parameters,
+				parameter.parameter_count);
 		}
 	}
 
-	return B_BAD_VALUE;	// B_DEV_INVALID_IOCTL?
+	load_period(handle, "sample_period", device->default_period);
+	load_period(handle, "min_sample_period", device->min_period);
+	load_period(handle, "max_sample_period", device->max_period);
+	if (device->max_period < device->min_period)
+		device->max_period = device->min_period;
+
+	device->adaptive = get_driver_boolean_parameter(handle, "adaptive_sampling",
+		device->adaptive, true);
+
+	const char* value = get_driver_parameter(handle, "idle_timeout", NULL, NULL);
+	if (value != NULL)
+		device->idle_timeout = strtol(value, NULL, 0) * 1000000LL;	// in s.
+
+	unload_driver_settings(handle);
 }
 
 
-// Text Interface.
+// "trace_probe true" starts tracing before the chip gets probed, so traces hold
+// all it takes to replay the chip without it (see IT87_SENSORS_READ_TRACE).
+// Needed before there's a chip to load the rest of the settings for.
+static bool
+load_trace_probe(void)
+{
+	void* handle = load_driver_settings(IT87_SENSOR_DEVICE_NAME);
+	if (handle == NULL)
+		return false;
+
+	bool traceProbe = get_driver_boolean_parameter(handle, "trace_probe", false, true);
+	unload_driver_settings(handle);
+	return traceProbe;
+}
+
 
 static status_t
-device_read(void* cookie, off_t position, void* buffer, size_t* num_bytes)
+start_sampler(it87_device* device)
 {
-	// 17*9 + 16*3 + 16*5. For volts, temps ("°" takes 2 bytes), and fans, respectively.
-	#define DATA_SIZE 281
+	// Start monitoring once, and keep the ADC running until the last user is gone.
+	start_monitoring(device);
 
-	if (*num_bytes < DATA_SIZE) {
-		*num_bytes = DATA_SIZE; // attempt to communicate how many bytes we actually need.
-		return ERANGE;
+	// Take a first sample synchronously, so readers never see an empty snapshot.
+	refresh_snapshot(device);
+
+	atomic_set(&device->idle, 0);
+	atomic_set64(&device->last_request, system_time());
+
+	bigtime_t period = group_min_period(device, atomic_get64(&device->sample_period));
+	for (int group = 0; group < IT87_GROUP_COUNT; group++)
+		atomic_set64(&device->group_periods[group], period);
+
+	device->sampler_sem = create_sem(0, "it87 sampler");
+	if (device->sampler_sem < 0) {
+		set_monitoring(device, false);
+		return device->sampler_sem;
 	}
 
-	if (position) {
-		*num_bytes = 0;
-		return B_OK;
+	device->sampler_thread = spawn_kernel_thread(it87_sampler, "it87 sampler",
+		B_LOW_PRIORITY, device);
+	if (device->sampler_thread < 0) {
+		delete_sem(device->sampler_sem);
+		set_monitoring(device, false);
+		return device->sampler_thread;
 	}
 
-	char buf[DATA_SIZE];
-	size_t bytes_written = 0;
-	it87_sensors_data data;
+	resume_thread(device->sampler_thread);
+	return B_OK;
+}
+
 
-	it87_refresh(data);
+static void
+stop_sampler(it87_device* device)
+{
+	delete_sem(device->sampler_sem);
 
-	OutFloat(&buf, &bytes_written, "VIN0 : %3d.%03d V\n", data.voltages[0], 1000);
-	OutFloat(&buf, &bytes_written, "VIN1 : %3d.%03d V\n", data.voltages[1], 1000);
-	OutFloat(&buf, &bytes_written, "VIN2 : %3d.%03d V\n", data.voltages[2], 1000);
-	OutFloat(&buf, &bytes_written, "VIN3 : %3d.%03d V\n", data.voltages[3], 1000);
-	OutFloat(&buf, &bytes_written, "VIN4 : %3d.%03d V\n", data.voltages[4], 1000);
-	OutFloat(&buf, &bytes_written, "VIN5 : %3d.%03d V\n", data.voltages[5], 1000);
-	OutFloat(&buf, &bytes_written, "VIN6 : %3d.%03d V\n", data.voltages[6], 1000);
-	OutFloat(&buf, &bytes_written, "VIN7 : %3d.%03d V\n", data.voltages[7], 1000);
-	OutFloat(&buf, &bytes_written, "VBAT : %3d.%03d V\n", data.voltages[8], 1000);
+	status_t result;
+	wait_for_thread(device->sampler_thread, &result);
 
-	OutInt(&buf, &bytes_written, "TEMP0: %4d °C\n", data.temps[0]);
-	OutInt(&buf, &bytes_written, "TEMP1: %4d °C\n", data.temps[1]);
-	OutInt(&buf, &bytes_written, "TEMP2: %4d °C\n", data.temps[2]);
+	set_monitoring(device, false);
+}
 
-	OutInt(&buf, &bytes_written, "FAN1 : %4d RPM\n", data.fans[0]);
-	OutInt(&buf, &bytes_written, "FAN2 : %4d RPM\n", data.fans[1]);
-	OutInt(&buf, &bytes_written, "FAN3 : %4d RPM\n", data.fans[2]);
 
-	if (gChipID != 0x8705 && gChipID != 0x8712) {
-		OutInt(&buf, &bytes_written, "FAN4 : %4d RPM\n", data.fans[3]);
-		OutInt(&buf, &bytes_written, "FAN5 : %4d RPM\n", data.fans[4]);
+// Resumes sampling if it was stopped for being idle, taking a sample right
+// away, so whoever asks gets a fresh one. Requests arriving meanwhile wait for
+// that sample on refresh_lock, instead of reading the old one.
+static void
+wake_sampler(it87_device* device)
+{
+	if (atomic_get(&device->idle) == 0)
+		return;
+
+	lock_refresh(device);
+	if (atomic_get(&device->idle) == 0) {
+		// Someone else got to it first.
+		release_sem(device->refresh_lock);
+		return;
 	}
 
-	if (user_memcpy(buffer, &buf, sizeof(buf)) != B_OK)
-		return B_BAD_ADDRESS;
+	start_monitoring(device);
+	refresh_locked(device, device->available_channels);
 
-	*num_bytes = bytes_written;
-	return B_OK;
+	// Only now, so nobody goes on with the sample from before.
+	atomic_set(&device->idle, 0);
+	release_sem(device->refresh_lock);
+	release_sem(device->sampler_sem);
+
+	atomic_add64(&device->stats.idle_wakeups, 1);
 }
 
 
+// Keeps the sampler running for as long as there's someone using the device.
+// Needs open_lock.
 static status_t
-device_write(void* cookie, off_t pos, const void* data, size_t* num_bytes)
+acquire_sampler(it87_device* device)
 {
-	*num_bytes = 0;
-	return B_NOT_ALLOWED;
+	if (device->open_count == 0) {
+		status_t status = start_sampler(device);
+		if (status != B_OK)
+			return status;
+	}
+
+	device->open_count++;
+	return B_OK;
 }
 
 
+// Needs open_lock.
+static void
+release_sampler(it87_device* device)
+{
+	if (--device->open_count == 0)
+		stop_sampler(device);
+}
+
 //-----------------------------------------------------------------------------
-//	#pragma mark - Driver Hooks
+//	#pragma mark - Device Hooks
 
-status_t
-init_hardware(void)
+// Per open() state.
+struct it87_cookie {
+	it87_device*	device;
+	it87_cookie*	next;		// in device->cookies.
+	sem_id			lock;
+	uint32			open_flags;
+	bool			raw;		// opened as IT87_RAW_DEVICE_NAME.
+
+	uint32			channels;	// see it87_sensors_subscription.
+	uint32			format;
+	bigtime_t		refresh_interval;
+	int32			last_sequence;
+	bigtime_t		last_request;
+	bool			area_user;	// got the area, might be reading it on its own.
+
+	// Text served to read(), taken when reading at position 0 (or the first
+	// time), so reading in small chunks gets a consistent snapshot.
+	bool			has_text;
+	size_t			text_length;
+	char			text[IT87_TEXT_SIZE];
+};
+
+// Published names: "sensor/it87/<index>" at [2 * index], and
+// "sensor/it87_raw/<index>" right after it.
+static char gDeviceNames[IT87_MAX_DEVICES * 2][B_OS_NAME_LENGTH];
+static const char* gPublishedNames[IT87_MAX_DEVICES * 2 + 1];
+
+
+static it87_device*
+find_device_by_name(const char* name, bool& raw)
 {
-	if (get_module(B_ISA_MODULE_NAME, (module_info**) &gISA) < 0)
-		return ENOSYS;
-
-	gChipID = it87xx_detect();
-	if (gChipID == 0x0000) {
-		TRACE("device not found.");
-		return B_DEVICE_NOT_FOUND;	// ENODEV
+	for (int32 i = 0; i < gDeviceCount * 2; i++) {
+		if (strcmp(name, gDeviceNames[i]) == 0) {
+			raw = (i & 1) != 0;
+			return &gDevices[i / 2];
+		}
 	}
+	return NULL;
+}
 
-	put_module(B_ISA_MODULE_NAME);
-	return B_OK;
+
+// Every read(), ioctl() and select() counts as activity, and gets served
+// fresh samples even if the sampler had stopped for lack of them.
+static void
+note_request(it87_cookie* cookie)
+{
+	bigtime_t now = system_time();
+	atomic_set64(&cookie->last_request, now);
+	atomic_set64(&cookie->device->last_request, now);
+
+	wake_sampler(cookie->device);
 }
 
 
-status_t
-init_driver(void)
+// Samples at least as often as the most demanding client wants. Needs
+// open_lock.
+static void
+update_sample_period(it87_device* device)
 {
-	if (get_module(B_ISA_MODULE_NAME, (module_info**) &gISA) < 0)
-		return ENOSYS;
+	bigtime_t period = device->adaptive ? device->max_period : device->default_period;
+	for (it87_cookie* cookie = device->cookies; cookie != NULL; cookie = cookie->next) {
+		if (cookie->refresh_interval > 0 && cookie->refresh_interval < period)
+			period = cookie->refresh_interval;
+	}
+	if (period < IT87_MIN_SAMPLE_PERIOD * 1000LL)
+		period = IT87_MIN_SAMPLE_PERIOD * 1000LL;
 
-	// Find out the proper ISA port address to talk to the EC.
-	gBaseAddress = find_isa_port_address();
+	if (atomic_get_and_set64(&device->sample_period, period) != period
+		&& device->open_count > 0)
+		release_sem(device->sampler_sem);	// let the sampler pick up the new period now.
+}
 
-	if (gBaseAddress == 0)
-		return ENOSYS;
 
-	uint8 vendor_id = ITESensorRead(IT87_REG_ITE_VENDOR_ID);
-	uint8 core_id = ITESensorRead(IT87_REG_CORE_ID);
-	uint8 rev_id = ITESensorRead(IT87_CONFIG_SELECT_CHIP_VER) & 0xF;
+static status_t
+device_open(const char name[], uint32 flags, void** _cookie)
+{
+	bool raw;
+	it87_device* device = find_device_by_name(name, raw);
+	if (device == NULL)
+		return B_ENTRY_NOT_FOUND;
+
+	it87_cookie* cookie = (it87_cookie*)malloc(sizeof(it87_cookie));
+	if (cookie == NULL)
+		return B_NO_MEMORY;
+
+	cookie->lock = create_sem(1, "it87 cookie");
+	if (cookie->lock < 0) {
+		status_t status = cookie->lock;
+		free(cookie);
+		return status;
+	}
+	cookie->device = device;
+	cookie->open_flags = flags;
+	cookie->raw = raw;
+	cookie->channels = ~(uint32)0;
+	cookie->format = IT87_FORMAT_TEXT;
+	// Raw readers want every sample the chip can give.
+	cookie->refresh_interval = cookie->raw ? IT87_MIN_SAMPLE_PERIOD * 1000LL : 0;
+	cookie->last_sequence = 0;
+	cookie->area_user = false;
+	cookie->has_text = false;
+	cookie->text_length = 0;
+
+	acquire_sem(device->open_lock);
+
+	status_t status = acquire_sampler(device);
+	if (status == B_OK) {
+		cookie->next = device->cookies;
+		device->cookies = cookie;
+		if (cookie->refresh_interval > 0)
+			update_sample_period(device);
+	}
 
-	INFO("ITE%4x found at address = 0x%04x. VENDOR_ID: 0x%02x - CORE_ID: 0x%02x - REV: 0x%02x\n",
-		gChipID, gBaseAddress, vendor_id, core_id, rev_id);
+	release_sem(device->open_lock);
 
-	// Enable 16-bits tachometers on chips that have them.
-	if (gChipID != 0x8705 && gChipID != 0x8712) {
-		uint8 counter_enable_reg = ITESensorRead(IT87_REG_FAN_16BITS);
-		ITESensorWrite(IT87_REG_FAN_16BITS, counter_enable_reg | 0x7); // set bits 2-0 bits to 1
+	if (status != B_OK) {
+		delete_sem(cookie->lock);
+		free(cookie);
+		return status;
 	}
 
+	note_request(cookie);
+
+	*_cookie = cookie;
 	return B_OK;
 }
 
 
-void
-uninit_driver(void)
+static status_t
+device_close(void* cookie)
 {
-	put_module(B_ISA_MODULE_NAME);
+	return B_OK;
 }
 
 
-const char**
-publish_devices()
+static status_t
+device_free(void* _cookie)
 {
-	static const char* names[] = {
-		"sensor/" IT87_SENSOR_DEVICE_NAME,
-		NULL
-	};
-	return names;
-}
+	it87_cookie* cookie = (it87_cookie*)_cookie;
+	it87_device* device = cookie->device;
 
+	acquire_sem(device->open_lock);
 
-device_hooks*
-find_device(const char name[])
-{
-	static device_hooks hooks = {
-		device_open,	// -> open entry point
-		device_close,	// -> close entry point
+	for (it87_cookie** link = &device->cookies; *link != NULL; link = &(*link)->next) {
+		if (*link == cookie) {
+			*link = cookie->next;
+			break;
+		}
+	}
+
+	if (cookie->refresh_interval > 0)
+		update_sample_period(device);
+	if (cookie->area_user)
+		atomic_add(&device->area_users, -1);
+	release_sampler(device);
+
+	release_sem(device->open_lock);
+
+	delete_sem(cookie->lock);
+	free(cookie);
+	return B_OK;
+}
+
+
+static status_t
+device_control(void* _cookie, uint32 operation, void* args, size_t length)
+{
+	it87_cookie* cookie = (it87_cookie*)_cookie;
+	it87_device* device = cookie->device;
+
+	note_request(cookie);
+
+	switch (operation) {
+		case IT87_SENSORS_READ:
+		{
+			it87_sensors_sample sample;
+			atomic_set(&cookie->last_sequence, read_snapshot(device, sample));
+
+			if (user_memcpy(args, &sample.data, sizeof(it87_sensors_data)) != B_OK)
+				return B_BAD_ADDRESS;
+
+			return B_OK;
+		}
+
+		case IT87_SENSORS_READ_CHANNELS:
+		{
+			it87_sensors_channels channels;
+			if (user_memcpy(&channels, args, sizeof(it87_sensors_channels)) != B_OK)
+				return B_BAD_ADDRESS;
+
+			// Goes straight to the chip, but only for the registers asked for.
+			channels.valid = channels.channels & device->available_channels;
+
+			int count = 0;
+			lock_hardware(device);
+			for (int32 i = 0; i < device->active_count; i++) {
+				int channel = device->active_sensors[i];
+				if ((channels.valid & IT87_CHANNEL_MASK(channel)) != 0)
+					channels.values[count++] = it87_read_sensor(device, device->sensors[channel]);
+			}
+			release_sem(device->hardware_lock);
+
+			if (user_memcpy(args, &channels, sizeof(it87_sensors_channels)) != B_OK)
+				return B_BAD_ADDRESS;
+
+			return B_OK;
+		}
+
+		case IT87_SENSORS_SET_LIMITS:
+		{
+			it87_sensors_limits limits;
+			if (user_memcpy(&limits, args, sizeof(it87_sensors_limits)) != B_OK)
+				return B_BAD_ADDRESS;
+
+			arm_limits(device, limits);
+
+			if (user_memcpy(args, &limits, sizeof(it87_sensors_limits)) != B_OK)
+				return B_BAD_ADDRESS;
+
+			return B_OK;
+		}
+
+		case IT87_SENSORS_GET_ALARMS:
+		{
+			// Only three register reads, much cheaper than a full refresh.
+			lock_hardware(device);
+			uint32 alarms = it87_read_alarms(device);
+			release_sem(device->hardware_lock);
+
+			alarms |= atomic_get_and_set(&device->latched_alarms, 0);
+
+			if (user_memcpy(args, &alarms, sizeof(uint32)) != B_OK)
+				return B_BAD_ADDRESS;
+
+			return B_OK;
+		}
+
+		case IT87_SENSORS_WAIT:
+		{
+			it87_sensors_wait wait;
+			if (user_memcpy(&wait, args, sizeof(it87_sensors_wait)) != B_OK)
+				return B_BAD_ADDRESS;
+
+			if (wait.sequence == -1)
+				wait.sequence = atomic_get(&cookie->last_sequence);
+
+			it87_sensors_sample sample;
+			status_t status = wait_for_sample(device, wait.sequence, wait.flags, wait.timeout,
+				sample);
+			if (status != B_OK)
+				return status;
+
+			atomic_set(&cookie->last_sequence, sample.sequence);
+			wait.sequence = sample.sequence;
+			wait.alarms = sample.alarms;
+			wait.data = sample.data;
+
+			if (user_memcpy(args, &wait, sizeof(it87_sensors_wait)) != B_OK)
+				return B_BAD_ADDRESS;
+
+			return B_OK;
+		}
+
+		case IT87_SENSORS_READ_HISTORY:
+		{
+			it87_sensors_history history;
+			if (user_memcpy(&history, args, sizeof(it87_sensors_history)) != B_OK)
+				return B_BAD_ADDRESS;
+
+			status_t status = read_history(device, history);
+			if (status != B_OK)
+				return status;
+
+			if (user_memcpy(args, &history, sizeof(it87_sensors_history)) != B_OK)
+				return B_BAD_ADDRESS;
+
+			return B_OK;
+		}
+
+		case IT87_SENSORS_REFRESH:
+		{
+			refresh_snapshot(device);
+
+			it87_sensors_sample sample;
+			atomic_set(&cookie->last_sequence, read_snapshot(device, sample));
+
+			if (args != NULL
+				&& user_memcpy(args, &sample, sizeof(it87_sensors_sample)) != B_OK)
+				return B_BAD_ADDRESS;
+
+			return B_OK;
+		}
+
+		case IT87_SENSORS_GET_SUBSCRIPTION:
+		{
+			it87_sensors_subscription subscription;
+			subscription.channels = cookie->channels;
+			subscription.format = cookie->format;
+			subscription.refresh_interval = cookie->refresh_interval;
+			subscription.last_sequence = atomic_get(&cookie->last_sequence);
+			subscription.last_request = atomic_get64(&cookie->last_request);
+
+			if (user_memcpy(args, &subscription, sizeof(it87_sensors_subscription)) != B_OK)
+				return B_BAD_ADDRESS;
+
+			return B_OK;
+		}
+
+		case IT87_SENSORS_SET_SUBSCRIPTION:
+		{
+			it87_sensors_subscription subscription;
+			if (user_memcpy(&subscription, args, sizeof(it87_sensors_subscription)) != B_OK)
+				return B_BAD_ADDRESS;
+
+			if (subscription.format > IT87_FORMAT_BINARY || subscription.refresh_interval < 0)
+				return B_BAD_VALUE;
+
+			acquire_sem(cookie->lock);
+			cookie->channels = subscription.channels;
+			cookie->format = subscription.format;
+			cookie->has_text = false;
+			release_sem(cookie->lock);
+
+			acquire_sem(device->open_lock);
+			cookie->refresh_interval = subscription.refresh_interval;
+			update_sample_period(device);
+			release_sem(device->open_lock);
+
+			return B_OK;
+		}
+
+		case IT87_SENSORS_GET_AREA:
+			if (user_memcpy(args, &device->shared_area, sizeof(area_id)) != B_OK)
+				return B_BAD_ADDRESS;
+
+			// Its reads won't show up as requests anymore.
+			acquire_sem(cookie->lock);
+			if (!cookie->area_user) {
+				cookie->area_user = true;
+				atomic_add(&device->area_users, 1);
+			}
+			release_sem(cookie->lock);
+			return B_OK;
+
+		case IT87_SENSORS_GET_STATS:
+		{
+			it87_sensors_stats stats;
+			read_stats(device, stats);
+
+			if (user_memcpy(args, &stats, sizeof(it87_sensors_stats)) != B_OK)
+				return B_BAD_ADDRESS;
+
+			return B_OK;
+		}
+
+		case IT87_SENSORS_RESET_STATS:
+			reset_stats(device);
+			return B_OK;
+
+		case IT87_SENSORS_START_TRACE:
+		{
+			lock_hardware(device);
+			status_t status = it87_start_trace(device);
+			release_sem(device->hardware_lock);
+			return status;
+		}
+
+		case IT87_SENSORS_STOP_TRACE:
+			lock_hardware(device);
+			it87_stop_trace(device);
+			release_sem(device->hardware_lock);
+			return B_OK;
+
+		case IT87_SENSORS_READ_TRACE:
+		{
+			it87_sensors_trace trace;
+			if (user_memcpy(&trace, args, sizeof(it87_sensors_trace)) != B_OK)
+				return B_BAD_ADDRESS;
+
+			status_t status = read_trace(device, trace);
+			if (status != B_OK)
+				return status;
+
+			if (user_memcpy(args, &trace, sizeof(it87_sensors_trace)) != B_OK)
+				return B_BAD_ADDRESS;
+
+			return B_OK;
+		}
+	}
+
+	return B_BAD_VALUE;	// B_DEV_INVALID_IOCTL?
+}
+
+
+// Blocks until there's a sample this cookie hasn't been given yet, and
+// returns it as an it87_sensors_sample.
+static status_t
+read_binary(it87_cookie* cookie, void* buffer, size_t* num_bytes)
+{
+	if (*num_bytes < sizeof(it87_sensors_sample))
+		return B_BAD_VALUE;
+
+	bigtime_t timeout = (cookie->open_flags & O_NONBLOCK) != 0 ? 0 : B_INFINITE_TIMEOUT;
+
+	it87_sensors_sample sample;
+	status_t status = wait_for_sample(cookie->device, atomic_get(&cookie->last_sequence),
+		0, timeout, sample);
+	if (status == B_TIMED_OUT)
+		status = B_WOULD_BLOCK;
+	if (status != B_OK) {
+		*num_bytes = 0;
+		return status;
+	}
+
+	if (user_memcpy(buffer, &sample, sizeof(it87_sensors_sample)) != B_OK) {
+		*num_bytes = 0;
+		return B_BAD_ADDRESS;
+	}
+
+	atomic_set(&cookie->last_sequence, sample.sequence);
+	*num_bytes = sizeof(it87_sensors_sample);
+	return B_OK;
+}
+
+
+// Blocks until there's at least one sample this cookie hasn't been given yet,
+// and returns as many it87_sensors_raw_records as fit.
+static status_t
+read_raw(it87_cookie* cookie, void* buffer, size_t* num_bytes)
+{
+	uint32 count = *num_bytes / sizeof(it87_sensors_raw_record);
+	*num_bytes = 0;
+
+	if (count == 0)
+		return B_BAD_VALUE;
+	if (count > IT87_HISTORY_SIZE)
+		count = IT87_HISTORY_SIZE;
+
+	bigtime_t timeout = (cookie->open_flags & O_NONBLOCK) != 0 ? 0 : B_INFINITE_TIMEOUT;
+
+	it87_sensors_sample sample;
+	status_t status = wait_for_sample(cookie->device, atomic_get(&cookie->last_sequence),
+		0, timeout, sample);
+	if (status == B_TIMED_OUT)
+		status = B_WOULD_BLOCK;
+	if (status != B_OK)
+		return status;
+
+	it87_sensors_raw_record* records
+		= (it87_sensors_raw_record*)malloc(count * sizeof(it87_sensors_raw_record));
+	if (records == NULL)
+		return B_NO_MEMORY;
+
+	acquire_sem(cookie->lock);
+
+	count = read_raw_records(cookie->device, atomic_get(&cookie->last_sequence), records,
+		count);
+
+	size_t length = count * sizeof(it87_sensors_raw_record);
+	if (count > 0 && user_memcpy(buffer, records, length) != B_OK)
+		status = B_BAD_ADDRESS;
+
+	if (status == B_OK && count > 0) {
+		atomic_set(&cookie->last_sequence, records[count - 1].sequence);
+		*num_bytes = length;
+	}
+
+	release_sem(cookie->lock);
+
+	free(records);
+	return status;
+}
+
+
+// Text Interface.
+
+static status_t
+device_read(void* _cookie, off_t position, void* buffer, size_t* num_bytes)
+{
+	it87_cookie* cookie = (it87_cookie*)_cookie;
+	it87_device* device = cookie->device;
+
+	if (position < 0)
+		return B_BAD_VALUE;
+
+	note_request(cookie);
+
+	if (cookie->raw)
+		return read_raw(cookie, buffer, num_bytes);
+	if (cookie->format == IT87_FORMAT_BINARY)
+		return read_binary(cookie, buffer, num_bytes);
+
+	acquire_sem(cookie->lock);
+
+	if (position == 0 || !cookie->has_text) {
+		int32 sequence;
+		if ((cookie->channels & device->available_channels) == device->available_channels) {
+			// Already rendered by the sampler, just copy it.
+			cookie->text_length = read_text(device, cookie->text, sequence);
+		} else {
+			it87_sensors_sample sample;
+			sequence = read_snapshot(device, sample);
+			cookie->text_length = it87_render_text(device, sample.data, cookie->text,
+				IT87_TEXT_SIZE, cookie->channels);
+		}
+		atomic_set(&cookie->last_sequence, sequence);
+		cookie->has_text = true;
+	}
+
+	size_t bytes_read = 0;
+	if (position < (off_t)cookie->text_length) {
+		bytes_read = cookie->text_length - position;
+		if (bytes_read > *num_bytes)
+			bytes_read = *num_bytes;
+	}
+
+	status_t status = B_OK;
+	if (bytes_read > 0 && user_memcpy(buffer, cookie->text + position, bytes_read) != B_OK)
+		status = B_BAD_ADDRESS;
+
+	release_sem(cookie->lock);
+
+	*num_bytes = status == B_OK ? bytes_read : 0;
+	return status;
+}
+
+
+static status_t
+device_write(void* cookie, off_t pos, const void* data, size_t* num_bytes)
+{
+	*num_bytes = 0;
+	return B_NOT_ALLOWED;
+}
+
+
+// "Readable" means "there's a sample this file descriptor hasn't been given yet".
+static status_t
+device_select(void* _cookie, uint8 event, uint32 ref, selectsync* sync)
+{
+	it87_cookie* cookie = (it87_cookie*)_cookie;
+	it87_device* device = cookie->device;
+
+	if (event != B_SELECT_READ)
+		return B_BAD_VALUE;
+
+	note_request(cookie);
+
+	status_t status = B_BUSY;
+
+	acquire_sem(device->select_lock);
+	for (int i = 0; i < IT87_MAX_SELECTS; i++) {
+		if (device->selects[i].sync == NULL) {
+			device->selects[i].sync = sync;
+			device->selects[i].event = event;
+			status = B_OK;
+			break;
+		}
+	}
+	release_sem(device->select_lock);
+
+	// Registered first, so a sample published right now isn't missed.
+	if (status == B_OK && current_sequence(device) != atomic_get(&cookie->last_sequence))
+		notify_select_event(sync, event);
+
+	return status;
+}
+
+
+static status_t
+device_deselect(void* _cookie, uint8 event, selectsync* sync)
+{
+	it87_device* device = ((it87_cookie*)_cookie)->device;
+
+	acquire_sem(device->select_lock);
+	for (int i = 0; i < IT87_MAX_SELECTS; i++) {
+		if (device->selects[i].sync == sync && device->selects[i].event == event)
+			device->selects[i].sync = NULL;
+	}
+	release_sem(device->select_lock);
+
+	return B_OK;
+}
+
+
+//-----------------------------------------------------------------------------
+//	#pragma mark - Driver Hooks
+
+static void
+delete_sems(it87_device* device)
+{
+	delete_sem(device->history_lock);
+	delete_sem(device->listener_lock);
+	delete_sem(device->select_lock);
+	delete_sem(device->publish_sem);
+	delete_sem(device->wait_lock);
+	delete_sem(device->open_lock);
+	delete_sem(device->refresh_lock);
+	delete_sem(device->hardware_lock);
+}
+
+
+// Sets up "device" for the chip behind its config_port, if there's a supported
+// one.
+static status_t
+init_device(it87_device* device)
+{
+	if (load_trace_probe())
+		it87_start_trace(device);
+
+	status_t status = it87_probe(device);
+	if (status != B_OK)
+		return status;
+
+	for (int32 i = 0; i < device->active_count; i++) {
+		int channel = device->active_sensors[i];
+		device->group_channels[device->sensors[channel].kind] |= IT87_CHANNEL_MASK(channel);
+	}
+
+	device->default_period = IT87_SAMPLE_PERIOD * 1000LL;
+	device->adaptive = true;
+	device->min_period = IT87_MIN_SAMPLE_PERIOD * 1000LL;
+	device->max_period = IT87_MAX_SAMPLE_PERIOD * 1000LL;
+	device->idle_timeout = IT87_IDLE_TIMEOUT * 1000000LL;
+	load_settings(device);
+	device->sample_period = device->adaptive ? device->max_period : device->default_period;
+
+	device->hardware_lock = create_sem(1, "it87 hardware");
+	device->refresh_lock = create_sem(1, "it87 refresh");
+	device->open_lock = create_sem(1, "it87 open");
+	device->wait_lock = create_sem(1, "it87 wait");
+	device->publish_sem = create_sem(0, "it87 publish");
+	device->select_lock = create_sem(1, "it87 select");
+	device->listener_lock = create_sem(1, "it87 listeners");
+	device->history_lock = create_sem(1, "it87 history");
+	if (device->hardware_lock < 0 || device->refresh_lock < 0 || device->open_lock < 0
+		|| device->wait_lock < 0 || device->publish_sem < 0 || device->select_lock < 0
+		|| device->listener_lock < 0 || device->history_lock < 0) {
+		delete_sems(device);
+		return B_NO_MORE_SEMS;
+	}
+
+	uint32 protection = B_KERNEL_READ_AREA | B_KERNEL_WRITE_AREA | B_READ_AREA;
+#ifdef B_CLONEABLE_AREA
+	protection |= B_CLONEABLE_AREA;
+#endif
+	char name[B_OS_NAME_LENGTH];
+	snprintf(name, sizeof(name), "it87 sensors %" B_PRId32, device->index);
+	size_t size = (sizeof(it87_sensors_shared) + B_PAGE_SIZE - 1) & ~(B_PAGE_SIZE - 1);
+	device->shared_area = create_area(name, (void**)&device->shared, B_ANY_KERNEL_ADDRESS,
+		size, B_FULL_LOCK, protection);
+	if (device->shared_area < 0) {
+		delete_sems(device);
+		return device->shared_area;
+	}
+	memset(device->shared, 0, sizeof(it87_sensors_shared));
+
+	return B_OK;
+}
+
+
+status_t
+init_hardware(void)
+{
+	if (get_module(B_ISA_MODULE_NAME, (module_info**) &gISA) < 0)
+		return ENOSYS;
+
+	status_t status = B_DEVICE_NOT_FOUND;	// ENODEV
+	for (size_t i = 0; i < IT87_MAX_DEVICES; i++) {
+		// The devices might be in use already (by the module), so don't touch them.
+		it87_chip chip;
+		memset(&chip, 0, sizeof(chip));
+		chip.config_port = kConfigPorts[i];
+		if (it87xx_detect(&chip) != 0x0000)
+			status = B_OK;
+	}
+
+	if (status != B_OK)
+		TRACE("device not found.");
+
+	put_module(B_ISA_MODULE_NAME);
+	return status;
+}
+
+
+// Probes every config port, and sets up a device for each chip found.
+// Reference counted, as both init_driver() and the module's std_ops() need them.
+static status_t
+init_devices(void)
+{
+	while (atomic_test_and_set(&gInitLock, 1, 0) != 0)
+		snooze(1000);
+
+	status_t status = B_OK;
+	if (gInitCount == 0) {
+		if (get_module(B_ISA_MODULE_NAME, (module_info**) &gISA) < 0)
+			status = ENOSYS;
+	}
+
+	if (gInitCount == 0 && status == B_OK) {
+		gDeviceCount = 0;
+		for (size_t i = 0; i < IT87_MAX_DEVICES; i++) {
+			it87_device* device = &gDevices[gDeviceCount];
+			memset(device, 0, sizeof(it87_device));
+			device->index = gDeviceCount;
+			device->config_port = kConfigPorts[i];
+
+			if (init_device(device) != B_OK) {
+				it87_stop_trace(device);
+				continue;
+			}
+
+			snprintf(gDeviceNames[gDeviceCount * 2], B_OS_NAME_LENGTH,
+				"sensor/" IT87_SENSOR_DEVICE_NAME "/%" B_PRId32, device->index);
+			snprintf(gDeviceNames[gDeviceCount * 2 + 1], B_OS_NAME_LENGTH,
+				"sensor/" IT87_RAW_DEVICE_NAME "/%" B_PRId32, device->index);
+			gPublishedNames[gDeviceCount * 2] = gDeviceNames[gDeviceCount * 2];
+			gPublishedNames[gDeviceCount * 2 + 1] = gDeviceNames[gDeviceCount * 2 + 1];
+			gDeviceCount++;
+		}
+		gPublishedNames[gDeviceCount * 2] = NULL;
+
+		if (gDeviceCount == 0) {
+			put_module(B_ISA_MODULE_NAME);
+			status = B_DEVICE_NOT_FOUND;
+		}
+	}
+
+	if (status == B_OK)
+		gInitCount++;
+
+	atomic_set(&gInitLock, 0);
+	return status;
+}
+
+
+static void
+uninit_devices(void)
+{
+	while (atomic_test_and_set(&gInitLock, 1, 0) != 0)
+		snooze(1000);
+
+	if (--gInitCount == 0) {
+		for (int32 i = 0; i < gDeviceCount; i++) {
+			it87_stop_trace(&gDevices[i]);
+			delete_area(gDevices[i].shared_area);
+			delete_sems(&gDevices[i]);
+		}
+		gDeviceCount = 0;
+
+		put_module(B_ISA_MODULE_NAME);
+	}
+
+	atomic_set(&gInitLock, 0);
+}
+
+
+status_t
+init_driver(void)
+{
+	return init_devices();
+}
+
+
+void
+uninit_driver(void)
+{
+	uninit_devices();
+}
+
+
+const char**
+publish_devices()
+{
+	return gPublishedNames;
+}
+
+
+device_hooks*
+find_device(const char name[])
+{
+	static device_hooks hooks = {
+		device_open,	// -> open entry point
+		device_close,	// -> close entry point
 		device_free,	// -> free cookie
 		device_control,	// -> control entry point
 		device_read,	// -> read entry point
 		device_write,	// -> write entry point
-		NULL,			// -> readv
-		NULL,			// -> writev
-		NULL,			// -> select
-		NULL,			// -> deselect
+		device_select,	// -> select entry point
+		device_deselect,	// -> deselect entry point
+		NULL,			// -> read_pages
+		NULL,			// -> write_pages
 	//	NULL,			// -> wakeup
 	//	NULL			// -> suspend
 	};
 
 	return &hooks;
 }
+
+
+//-----------------------------------------------------------------------------
+//	#pragma mark - Module
+
+static it87_device*
+module_device(int32 index)
+{
+	if (index < 0 || index >= gDeviceCount)
+		return NULL;
+	return &gDevices[index];
+}
+
+
+static int32
+module_count_devices(void)
+{
+	return gDeviceCount;
+}
+
+
+static status_t
+module_get_snapshot(int32 index, it87_sensors_sample* sample)
+{
+	it87_device* device = module_device(index);
+	if (device == NULL)
+		return B_BAD_INDEX;
+
+	read_snapshot(device, *sample);
+	return B_OK;
+}
+
+
+static status_t
+module_register_listener(int32 index, it87_sensors_listener listener, void* cookie)
+{
+	it87_device* device = module_device(index);
+	if (device == NULL)
+		return B_BAD_INDEX;
+
+	status_t status = B_NO_MEMORY;
+
+	acquire_sem(device->listener_lock);
+	for (int i = 0; i < IT87_MAX_LISTENERS; i++) {
+		if (device->listeners[i].function == NULL) {
+			device->listeners[i].function = listener;
+			device->listeners[i].cookie = cookie;
+			status = B_OK;
+			break;
+		}
+	}
+	release_sem(device->listener_lock);
+
+	return status;
+}
+
+
+static status_t
+module_unregister_listener(int32 index, it87_sensors_listener listener, void* cookie)
+{
+	it87_device* device = module_device(index);
+	if (device == NULL)
+		return B_BAD_INDEX;
+
+	status_t status = B_ENTRY_NOT_FOUND;
+
+	acquire_sem(device->listener_lock);
+	for (int i = 0; i < IT87_MAX_LISTENERS; i++) {
+		if (device->listeners[i].function == listener
+			&& device->listeners[i].cookie == cookie) {
+			device->listeners[i].function = NULL;
+			status = B_OK;
+			break;
+		}
+	}
+	release_sem(device->listener_lock);
+
+	return status;
+}
+
+
+static status_t
+module_set_limits(int32 index, it87_sensors_limits* limits)
+{
+	it87_device* device = module_device(index);
+	if (device == NULL)
+		return B_BAD_INDEX;
+
+	arm_limits(device, *limits);
+	return B_OK;
+}
+
+
+static void
+release_samplers(int32 count)
+{
+	for (int32 i = 0; i < count; i++) {
+		atomic_add(&gDevices[i].pinned, -1);
+
+		acquire_sem(gDevices[i].open_lock);
+		release_sampler(&gDevices[i]);
+		release_sem(gDevices[i].open_lock);
+	}
+}
+
+
+// Every chip keeps being sampled for as long as the module is held.
+static status_t
+module_std_ops(int32 op, ...)
+{
+	switch (op) {
+		case B_MODULE_INIT:
+		{
+			status_t status = init_devices();
+			if (status != B_OK)
+				return status;
+
+			for (int32 i = 0; i < gDeviceCount; i++) {
+				acquire_sem(gDevices[i].open_lock);
+				status = acquire_sampler(&gDevices[i]);
+				release_sem(gDevices[i].open_lock);
+
+				if (status != B_OK) {
+					release_samplers(i);
+					uninit_devices();
+					return status;
+				}
+
+				// Listeners don't make requests, so don't let it go idle.
+				atomic_add(&gDevices[i].pinned, 1);
+				wake_sampler(&gDevices[i]);
+			}
+			return B_OK;
+		}
+
+		case B_MODULE_UNINIT:
+			release_samplers(gDeviceCount);
+			uninit_devices();
+			return B_OK;
+	}
+
+	return B_ERROR;
+}
+
+
+static it87_sensors_module_info gModuleInfo = {
+	{
+		IT87_SENSORS_MODULE_NAME,
+		0,
+		module_std_ops
+	},
+	module_count_devices,
+	module_get_snapshot,
+	module_register_listener,
+	module_unregister_listener,
+	module_set_limits,
+};
+
+module_info* modules[] = {
+	(module_info*)&gModuleInfo,
+	NULL
+};
@@ -10,6 +10,7 @@
 #define _IT87_SENSORS_H_
 
 #include <Drivers.h>
+#include <module.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -19,6 +20,55 @@ extern "C" {
 enum {
 	IT87_SENSORS_OP_BASE = B_DEVICE_OP_CODES_END + 'it87',
 	IT87_SENSORS_READ = IT87_SENSORS_OP_BASE + 1,
+	IT87_SENSORS_READ_CHANNELS = IT87_SENSORS_OP_BASE + 2,
+	IT87_SENSORS_GET_STATS = IT87_SENSORS_OP_BASE + 3,
+	IT87_SENSORS_RESET_STATS = IT87_SENSORS_OP_BASE + 4,
+	IT87_SENSORS_SET_LIMITS = IT87_SENSORS_OP_BASE + 5,
+	IT87_SENSORS_GET_ALARMS = IT87_SENSORS_OP_BASE + 6,	// arg: uint32*, channel mask.
+	IT87_SENSORS_WAIT = IT87_SENSORS_OP_BASE + 7,
+	IT87_SENSORS_READ_HISTORY = IT87_SENSORS_OP_BASE + 8,
+	IT87_SENSORS_GET_AREA = IT87_SENSORS_OP_BASE + 9,	// arg: area_id*, see it87_sensors_shared.
+	IT87_SENSORS_GET_SUBSCRIPTION = IT87_SENSORS_OP_BASE + 10,
+	IT87_SENSORS_SET_SUBSCRIPTION = IT87_SENSORS_OP_BASE + 11,
+	IT87_SENSORS_REFRESH = IT87_SENSORS_OP_BASE + 12,	// arg: it87_sensors_sample*, or NULL.
+	IT87_SENSORS_START_TRACE = IT87_SENSORS_OP_BASE + 13,
+	IT87_SENSORS_STOP_TRACE = IT87_SENSORS_OP_BASE + 14,
+	IT87_SENSORS_READ_TRACE = IT87_SENSORS_OP_BASE + 15,
+};
+
+
+// Channel numbers, for use with IT87_CHANNEL_MASK().
+enum {
+	IT87_CHANNEL_VIN0 = 0,
+	IT87_CHANNEL_VIN1,
+	IT87_CHANNEL_VIN2,
+	IT87_CHANNEL_VIN3,
+	IT87_CHANNEL_VIN4,
+	IT87_CHANNEL_VIN5,
+	IT87_CHANNEL_VIN6,
+	IT87_CHANNEL_VIN7,
+	IT87_CHANNEL_VBAT,
+	IT87_CHANNEL_TEMP0,
+	IT87_CHANNEL_TEMP1,
+	IT87_CHANNEL_TEMP2,
+	IT87_CHANNEL_FAN1,
+	IT87_CHANNEL_FAN2,
+	IT87_CHANNEL_FAN3,
+	IT87_CHANNEL_FAN4,
+	IT87_CHANNEL_FAN5,
+
+	IT87_CHANNEL_COUNT
+};
+
+#define IT87_CHANNEL_MASK(channel)	((uint32)1 << (channel))
+
+// Channel groups, each one sampled at its own rate. See it87_sensors_stats.
+enum {
+	IT87_GROUP_VOLTAGES = 0,	// VIN0 to VBAT.
+	IT87_GROUP_TEMPS,
+	IT87_GROUP_FANS,
+
+	IT87_GROUP_COUNT
 };
 
 
@@ -29,6 +79,226 @@ typedef struct {
 } it87_sensors_data;
 
 
+// For IT87_SENSORS_READ_CHANNELS. Only the requested registers are read.
+typedef struct {
+	uint32	channels;					// in: IT87_CHANNEL_MASK()s wanted.
+	uint32	valid;						// out: channels actually read.
+	int16	values[IT87_CHANNEL_COUNT];	// out: one per "valid" bit, in channel order.
+} it87_sensors_channels;
+
+
+// For IT87_SENSORS_SET_LIMITS. Same units as it87_sensors_data, indexed by
+// channel number. Fans only have a low limit, and VBAT has no limits at all.
+typedef struct {
+	uint32	channels;					// in: IT87_CHANNEL_MASK()s to program.
+	uint32	valid;						// out: channels actually programmed.
+	int16	low[IT87_CHANNEL_COUNT];
+	int16	high[IT87_CHANNEL_COUNT];
+} it87_sensors_limits;
+
+
+// A sample, as kept in the driver's history.
+typedef struct {
+	int32				sequence;	// 1 for the first sample taken, and counting.
+									// Wraps around, skipping 0 and -1.
+	uint32				alarms;		// channels out of limits, as IT87_CHANNEL_MASK()s.
+	bigtime_t			timestamp;	// system_time() when taken.
+	it87_sensors_data	data;
+} it87_sensors_sample;
+
+
+// Register contents behind a sample, before any conversion. Indexed by channel
+// number (0 for channels the chip doesn't have). "fan_ext" holds the high byte
+// of the 16-bit tachometers.
+typedef struct {
+	uint8	registers[IT87_CHANNEL_COUNT];
+	uint8	fan_ext[5];
+} it87_sensors_raw;
+
+// What read() returns on /dev/sensor/it87_raw/N: as many records as fit in the
+// buffer, oldest first. A gap in "sequence" means the reader fell more than
+// IT87_HISTORY_SIZE samples behind. While that device is open, the driver
+// samples every 100 ms (IT87_MIN_SAMPLE_PERIOD).
+typedef struct {
+	int32				sequence;
+	bigtime_t			timestamp;
+	it87_sensors_raw	raw;
+} __attribute__((packed)) it87_sensors_raw_record;
+
+
+// Layout of the (read-only) area returned by IT87_SENSORS_GET_AREA, always
+// holding the latest sample. clone_area() it, and read it with it87_read_shared(),
+// no syscalls involved.
+//
+// The driver fills the buffer readers aren't using, bumping "sequence" to odd
+// while at it, and back to even when done. The counter and each buffer sit on
+// cache lines of their own, so filling one buffer doesn't keep invalidating
+// the lines readers of the other are copying.
+#define IT87_CACHE_LINE_SIZE	64
+
+typedef struct {
+	it87_sensors_sample	sample;
+} __attribute__((aligned(IT87_CACHE_LINE_SIZE))) it87_sensors_buffer;
+
+typedef struct {
+	int32				sequence __attribute__((aligned(IT87_CACHE_LINE_SIZE)));
+	it87_sensors_buffer	buffers[2];
+} it87_sensors_shared;
+
+
+// Returns how many times the copy had to be redone.
+static inline int32
+it87_read_shared(const it87_sensors_shared* shared, it87_sensors_sample* sample)
+{
+	for (int32 retries = 0; ; retries++) {
+		int32 current = __atomic_load_n(&shared->sequence, __ATOMIC_ACQUIRE);
+
+		*sample = shared->buffers[(current >> 1) & 1].sample;
+
+		// Don't let the copy above be reordered past the check below.
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+		// The buffer just copied only gets reused by the update that follows
+		// the one that might be in progress right now.
+		int32 now = __atomic_load_n(&shared->sequence, __ATOMIC_ACQUIRE);
+		if ((uint32)now - (uint32)(current & ~1) < 3)
+			return retries;
+	}
+}
+
+
+// For IT87_SENSORS_READ_HISTORY. The driver keeps the last IT87_HISTORY_SIZE samples.
+#define IT87_HISTORY_SIZE	1024
+
+typedef struct {
+	int32					sequence;	// in: only return samples newer than this one.
+	uint32					count;		// in: room in "samples". out: samples returned.
+	it87_sensors_sample*	samples;	// oldest first.
+} it87_sensors_history;
+
+
+// Output formats for read().
+enum {
+	IT87_FORMAT_TEXT	= 0,	// what "cat /dev/sensor/it87/N" shows.
+	IT87_FORMAT_BINARY	= 1,	// one it87_sensors_sample per read(), blocks until
+								// there's a sample this client hasn't seen yet.
+};
+
+// Per open() settings. See IT87_SENSORS_GET/SET_SUBSCRIPTION.
+typedef struct {
+	uint32		channels;			// IT87_CHANNEL_MASK()s shown by the text format.
+	uint32		format;				// IT87_FORMAT_*.
+	bigtime_t	refresh_interval;	// µs between samples this client wants, 0 if it
+									// doesn't care. The driver samples at the rate
+									// of the most demanding client.
+	int32		last_sequence;		// read-only: last sample delivered to this client.
+	bigtime_t	last_request;		// read-only: system_time() of this client's last
+									// read(), ioctl() or select().
+} it87_sensors_subscription;
+
+
+// it87_sensors_wait flags.
+enum {
+	IT87_WAIT_FOR_ALARMS	= 0x01,	// only wake up for samples with channels out of limits.
+};
+
+// For IT87_SENSORS_WAIT. Blocks until a sample newer than "sequence" gets taken.
+typedef struct {
+	int32		sequence;	// in: last sample seen (0 for none, -1 for the last one
+							// delivered through this file descriptor). out: the new one.
+	uint32		flags;
+	bigtime_t	timeout;	// in: µs, relative. B_INFINITE_TIMEOUT to wait forever.
+	uint32		alarms;		// out: channels out of limits in that sample.
+	it87_sensors_data	data;	// out: the sample itself.
+} it87_sensors_wait;
+
+
+// One port access, as recorded between IT87_SENSORS_START_TRACE and
+// IT87_SENSORS_STOP_TRACE, or from the probe on with "trace_probe true" in
+// the driver settings. Replaying what each register read back reproduces what
+// the driver saw (see host/it87_replay.h).
+typedef struct {
+	bigtime_t	timestamp;	// system_time() when done.
+	uint16		port;
+	uint8		value;		// written, or read back.
+	uint8		write;		// 1 for write_io_8(), 0 for read_io_8().
+} it87_port_op;
+
+// For IT87_SENSORS_READ_TRACE. The driver keeps the last IT87_TRACE_SIZE port
+// accesses, and each one is returned only once.
+#define IT87_TRACE_SIZE		4096
+
+typedef struct {
+	uint32			count;		// in: room in "ops". out: ops returned.
+	uint32			dropped;	// out: ops overwritten before being read, since
+								// the last IT87_SENSORS_READ_TRACE.
+	it87_port_op*	ops;		// oldest first.
+} it87_sensors_trace;
+
+
+#define IT87_LATENCY_BUCKETS	16
+
+// For IT87_SENSORS_GET_STATS. Counted since load time, or the last IT87_SENSORS_RESET_STATS.
+typedef struct {
+	int64		refreshes;
+	bigtime_t	total_latency;		// µs spent refreshing, all refreshes together.
+	bigtime_t	max_latency;		// µs
+	int64		latency_histogram[IT87_LATENCY_BUCKETS];	// [n]: < 2^(n+1) µs
+
+	int64		port_reads;			// read_io_8() calls, of any kind.
+	int64		port_writes;		// write_io_8() calls, of any kind.
+	int64		config_reads;		// MB PnP config registers (at 0x2E/0x2F).
+	int64		config_writes;
+	int64		sensor_reads;		// EC registers (at the ISA base address).
+	int64		sensor_writes;
+
+	int64		coalesced_refreshes;	// IT87_SENSORS_REFRESH calls (or sampler runs)
+										// served by a refresh already in flight.
+
+	int64		refresh_port_ops;		// port accesses done by the last refresh.
+	int64		refresh_port_budget;	// how many a refresh should take on this chip.
+	int64		over_budget_refreshes;	// refreshes that took more than that.
+
+	int64		snapshot_reads;			// of the shared snapshot (or its text), in
+										// the driver. Userland readers aren't counted.
+	int64		snapshot_retries;		// reads redone, as the buffer got recycled.
+	int64		hardware_lock_contended;	// times hardware_lock wasn't free.
+	bigtime_t	hardware_lock_wait;		// µs spent waiting for it, all together.
+	int64		refresh_lock_contended;	// same, for refreshes (coalesced or not).
+	bigtime_t	refresh_lock_wait;
+
+	bigtime_t	group_periods[IT87_GROUP_COUNT];	// µs between samples of each
+											// channel group right now. Not reset.
+
+	int64		idle_stops;				// times sampling stopped for lack of requests.
+	int64		idle_wakeups;			// times a request started it again.
+} it87_sensors_stats;
+
+
+// In-kernel interface, for other drivers and modules. Served from the same
+// cached samples as the devices, no copies to or from userland involved.
+// Sampling runs for as long as the module is held (get_module()/put_module()).
+// "device" is the N in /dev/sensor/it87/N.
+#define IT87_SENSORS_MODULE_NAME	"drivers/bin/it87/v1"
+
+// Called right after each sample gets published, from whichever thread took it
+// (usually the sampler). Must not block, nor (un)register listeners.
+typedef void (*it87_sensors_listener)(void* cookie, int32 device,
+	const it87_sensors_sample* sample);
+
+typedef struct {
+	module_info	info;
+
+	int32		(*count_devices)(void);
+	status_t	(*get_snapshot)(int32 device, it87_sensors_sample* sample);
+	status_t	(*register_listener)(int32 device, it87_sensors_listener listener,
+					void* cookie);
+	status_t	(*unregister_listener)(int32 device, it87_sensors_listener listener,
+					void* cookie);
+	status_t	(*set_limits)(int32 device, it87_sensors_limits* limits);
+} it87_sensors_module_info;
+
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,861 @@
+//
+// Copyright 2003-2006, 2022-2023, Oscar Lesta. All right reserved.
+// Distributed under the terms of the MIT License.
+//
+// Chip side of the it87 driver, see it87_core.h.
+//
+
+#include <Errors.h>
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "it87_regs.h"
+#include "it87_core.h"
+
+//-----------------------------------------------------------------------------
+
+#define IT87_ADDRESS_REG	(chip->base_address + IT87_ADDR_PORT_OFFSET)
+#define IT87_DATA_REG		(chip->base_address + IT87_DATA_PORT_OFFSET)
+
+isa_module_info* gISA;
+
+
+//-----------------------------------------------------------------------------
+//	#pragma mark - Hardware I/O
+
+static inline void
+trace_port_op(it87_chip* chip, uint16 port, uint8 value, bool write)
+{
+	it87_port_trace* trace = chip->trace;
+
+	// Make room by dropping the oldest one, if it wasn't read yet.
+	if (trace->recorded - trace->read == IT87_TRACE_SIZE) {
+		trace->read++;
+		trace->dropped++;
+	}
+
+	it87_port_op& op = trace->ops[trace->recorded++ % IT87_TRACE_SIZE];
+	op.timestamp = system_time();
+	op.port = port;
+	op.value = value;
+	op.write = write;
+}
+
+
+// All port accesses go through these two, so they can be accounted for (and
+// traced).
+static inline uint8
+io_read_8(it87_chip* chip, uint16 port)
+{
+	atomic_add64(&chip->stats.port_reads, 1);
+	uint8 value = gISA->read_io_8(port);
+	if (chip->trace != NULL)
+		trace_port_op(chip, port, value, false);
+	return value;
+}
+
+
+static inline void
+io_write_8(it87_chip* chip, uint16 port, uint8 value)
+{
+	atomic_add64(&chip->stats.port_writes, 1);
+	gISA->write_io_8(port, value);
+	if (chip->trace != NULL)
+		trace_port_op(chip, port, value, true);
+}
+
+
+static inline uint8
+read_indexed(it87_chip* chip, uint16 port, uint8 reg)
+{
+	atomic_add64(&chip->stats.config_reads, 1);
+	io_write_8(chip, port, reg);
+	return io_read_8(chip, port + 1);
+}
+
+
+static inline void
+write_indexed(it87_chip* chip, uint16 port, uint8 reg, uint8 value)
+{
+	atomic_add64(&chip->stats.config_writes, 1);
+	io_write_8(chip, port, reg);
+	io_write_8(chip, port + 1, value);
+}
+
+
+static inline void
+enter_mb_pnp_mode(it87_chip* chip)
+{
+	// Write 0x87, 0x01, 0x55, 0x55 to the config port to enter MB PnP Mode.
+	// Chips strapped to 0x4E want 0xAA as the last key byte instead.
+	uint16 port = chip->config_port;
+	io_write_8(chip, port, 0x87);
+	io_write_8(chip, port, 0x01);
+	io_write_8(chip, port, 0x55);
+	io_write_8(chip, port, port == 0x4E ? 0xAA : 0x55);
+}
+
+
+static inline void
+exit_mb_pnp_mode(it87_chip* chip)
+{
+	//---- Set bit 1 to 1 in register at index 0x2 to leave MB PnP Mode.
+	// Return to the "Wait for Key" state after we're done with the config.
+	uint16 port = chip->config_port;
+	write_indexed(chip, port, 0x02, read_indexed(chip, port, 0x02) | (1 << 1));
+}
+
+
+static const chip_info* find_chip(uint16 id);
+
+
+uint16
+it87xx_detect(it87_chip* chip)
+{
+	uint16 result = 0x0000; // Return this if we don't find a supported ITE chip.
+	uint16 port = chip->config_port;
+
+	enter_mb_pnp_mode(chip);
+
+	uint16 chip_id = (read_indexed(chip, port, 0x20) << 8)
+		| read_indexed(chip, port, 0x21);
+	if (find_chip(chip_id) != NULL)
+		result = chip_id;	// an ITE IT87xx was found.
+
+	exit_mb_pnp_mode(chip);
+
+	return result;
+}
+
+
+static uint16
+find_isa_port_address(it87_chip* chip)
+{
+	uint16 port = 0;
+	uint16 config = chip->config_port;
+
+	enter_mb_pnp_mode(chip);
+
+	// Select the proper logical device: LDN 0x4 = Enviromental Controller (EC).
+	write_indexed(chip, config, 0x07, 0x4);
+
+	// Make sure the EC is active.
+	write_indexed(chip, config, 0x30, 0x1);
+
+	// Now fetch the base address port.
+	port = read_indexed(chip, config, 0x60) << 8;
+	port |= read_indexed(chip, config, 0x61);
+
+	exit_mb_pnp_mode(chip);
+	return port;
+}
+
+/*
+int set_bit(int n, int k)
+{
+	return (n | (1 << k));
+}
+
+
+int clear_bit(int n, int k)
+{
+	return (n & (~(1 << k)));
+}
+
+
+int toggle_bit(int n, int k)
+{
+	return (n ^ (1 << k));
+}
+*/
+
+//-----------------------------------------------------------------------------
+//	#pragma mark - Misc
+
+static inline uint8
+ITESensorRead(it87_chip* chip, int regNum)
+{
+	atomic_add64(&chip->stats.sensor_reads, 1);
+	io_write_8(chip, IT87_ADDRESS_REG, regNum);
+	return io_read_8(chip, IT87_DATA_REG);
+}
+
+
+static inline void
+ITESensorWrite(it87_chip* chip, int regNum, uint8 value)
+{
+	atomic_add64(&chip->stats.sensor_writes, 1);
+	io_write_8(chip, IT87_ADDRESS_REG, regNum);
+	io_write_8(chip, IT87_DATA_REG, value);
+}
+
+
+// The configuration register lives in the EC bank, like the sensors.
+void
+it87_config(it87_chip* chip, bool enable)
+{
+	uint8 value = ITESensorRead(chip, IT87_REG_CONFIG);
+	if (enable) {
+		value |= (1 << 6); // Update VBAT
+		value |= (1 << 0); // Start Monitoring Operations
+	} else {
+		value &= ~(1 << 6); // Don't update VBAT
+		value &= ~(1 << 0); // Stop Monitoring Operations
+	}
+	ITESensorWrite(chip, IT87_REG_CONFIG, value);
+}
+
+
+/*
+static inline uint8
+ITESensorReadValue(int regNum)
+{
+	while (io_read_8(IT87_ADDRESS_REG) & IT87_BUSY) {
+		spin(IT87_WAIT);
+	}
+	return ITESensorRead(chip, regNum);
+}
+*/
+
+//-----------------------------------------------------------------------------
+//	#pragma mark - utils funcs
+
+static inline int
+TwosComplement(uint8 value)
+{
+	return (value & 1 << 7) ? (~(unsigned)value) + 1 : value;
+}
+
+
+static inline int
+CountToRPM(uint8 count)
+{
+	if (count == 255)
+		return 0;
+	if (count < 2)
+		count = 152;
+	return 1350000 / (count * 2);
+}
+
+static inline int
+Count16ToRPM(uint16 count)
+{
+	if (count == 0 || count == 255 || count == 0xffff)
+		return 0;
+	return 675000 / count;
+}
+
+
+// Single pass text output: tracks the length as it goes, and never writes
+// past "size".
+struct text_output {
+	char*	buffer;
+	size_t	size;
+	size_t	length;
+};
+
+
+static inline void
+OutChar(text_output& out, char c)
+{
+	if (out.length < out.size)
+		out.buffer[out.length++] = c;
+}
+
+
+static inline void
+OutString(text_output& out, const char* string)
+{
+	while (*string != '\0')
+		OutChar(out, *string++);
+}
+
+
+// Right aligned to "width", sign included.
+static void
+OutNumber(text_output& out, uint magnitude, bool negative, int width)
+{
+	char digits[12];
+	int count = 0;
+	do {
+		digits[count++] = '0' + magnitude % 10;
+		magnitude /= 10;
+	} while (magnitude != 0);
+
+	if (negative)
+		digits[count++] = '-';
+
+	for (int i = count; i < width; i++)
+		OutChar(out, ' ');
+	while (count > 0)
+		OutChar(out, digits[--count]);
+}
+
+
+static void
+OutInt(text_output& out, int value, int width)
+{
+	OutNumber(out, value < 0 ? -(uint)value : value, value < 0, width);
+}
+
+
+// Prints value / scale, with "decimals" fractional digits (scale = 10^decimals).
+static void
+OutFloat(text_output& out, int value, uint scale, int decimals, int width)
+{
+	uint absolute = value < 0 ? -(uint)value : value;
+	OutNumber(out, absolute / scale, value < 0, width);
+	OutChar(out, '.');
+
+	uint fraction = absolute % scale;
+	for (uint divisor = scale / 10; decimals > 0; decimals--, divisor /= 10)
+		OutChar(out, '0' + (fraction / divisor) % 10);
+}
+
+
+//-----------------------------------------------------------------------------
+//	#pragma mark - Sensors
+
+#define VOLTAGE(n)	(offsetof(it87_sensors_data, voltages) + (n) * sizeof(int16))
+#define TEMP(n)		(offsetof(it87_sensors_data, temps) + (n) * sizeof(int16))
+#define FAN(n)		(offsetof(it87_sensors_data, fans) + (n) * sizeof(int16))
+
+// Indexed by channel. Tweaked for the actual chip by build_sensor_table().
+static const sensor_desc kSensors[IT87_CHANNEL_COUNT] = {
+	{ "VIN0", SENSOR_VOLTAGE, VOLTAGE(0), IT87_REG_VIN0, 0,
+		{ IT87_REG_LIM_VIN0_HI, IT87_REG_LIM_VIN0_LOW }, 8, 1, 1, 0, false, true },
+	{ "VIN1", SENSOR_VOLTAGE, VOLTAGE(1), IT87_REG_VIN1, 0,
+		{ IT87_REG_LIM_VIN1_HI, IT87_REG_LIM_VIN1_LOW }, 9, 1, 1, 0, false, true },
+	{ "VIN2", SENSOR_VOLTAGE, VOLTAGE(2), IT87_REG_VIN2, 0,
+		{ IT87_REG_LIM_VIN2_HI, IT87_REG_LIM_VIN2_LOW }, 10, 1, 1, 0, false, true },
+	// +5V. (6854.4 mV / 255)
+	{ "VIN3", SENSOR_VOLTAGE, VOLTAGE(3), IT87_REG_VIN3, 0,
+		{ IT87_REG_LIM_VIN3_HI, IT87_REG_LIM_VIN3_LOW }, 11, 168, 100, 0, false, true },
+	// +12V. (16320 mV / 255)
+	{ "VIN4", SENSOR_VOLTAGE, VOLTAGE(4), IT87_REG_VIN4, 0,
+		{ IT87_REG_LIM_VIN4_HI, IT87_REG_LIM_VIN4_LOW }, 12, 4, 1, 0, false, true },
+	// This can either be -12V, or RAM Voltage
+	{ "VIN5", SENSOR_VOLTAGE, VOLTAGE(5), IT87_REG_VIN5, 0,
+		{ IT87_REG_LIM_VIN5_HI, IT87_REG_LIM_VIN5_LOW }, 13, 1, 1, 0, false, true },
+	// This can either be -5V, or HT Voltage
+	{ "VIN6", SENSOR_VOLTAGE, VOLTAGE(6), IT87_REG_VIN6, 0,
+		{ IT87_REG_LIM_VIN6_HI, IT87_REG_LIM_VIN6_LOW }, 14, 1, 1, 0, false, true },
+	// +5V SB
+	{ "VIN7", SENSOR_VOLTAGE, VOLTAGE(7), IT87_REG_VIN7, 0,
+		{ IT87_REG_LIM_VIN7_HI, IT87_REG_LIM_VIN7_LOW }, 15, 168, 100, 0, false, true },
+	{ "VBAT", SENSOR_VOLTAGE, VOLTAGE(8), IT87_REG_VBAT, 0,
+		{ 0, 0 }, NO_ALARM, 1, 1, 0, false, true },
+
+	{ "TEMP0", SENSOR_TEMP, TEMP(0), IT87_REG_TEMP0, 0,
+		{ IT87_REG_LIM_TEMP0_HI, IT87_REG_LIM_TEMP0_LOW }, 16, 1, 1, 0, false, true },
+	{ "TEMP1", SENSOR_TEMP, TEMP(1), IT87_REG_TEMP1, 0,
+		{ IT87_REG_LIM_TEMP1_HI, IT87_REG_LIM_TEMP1_LOW }, 17, 1, 1, 0, false, true },
+	{ "TEMP2", SENSOR_TEMP, TEMP(2), IT87_REG_TEMP2, 0,
+		{ IT87_REG_LIM_TEMP2_HI, IT87_REG_LIM_TEMP2_LOW }, 18, 1, 1, 0, false, true },
+
+	{ "FAN1", SENSOR_FAN, FAN(0), IT87_REG_FAN_1, IT87_REG_FAN_1_EXT,
+		{ IT87_REG_FAN_LIMIT1, IT87_REG_FAN_LIMIT1_EXT }, 0, 1, 1, 0, true, true },
+	{ "FAN2", SENSOR_FAN, FAN(1), IT87_REG_FAN_2, IT87_REG_FAN_2_EXT,
+		{ IT87_REG_FAN_LIMIT2, IT87_REG_FAN_LIMIT2_EXT }, 1, 1, 1, 0, true, true },
+	{ "FAN3", SENSOR_FAN, FAN(2), IT87_REG_FAN_3, IT87_REG_FAN_3_EXT,
+		{ IT87_REG_FAN_LIMIT3, IT87_REG_FAN_LIMIT3_EXT }, 2, 1, 1, 0, true, true },
+	{ "FAN4", SENSOR_FAN, FAN(3), IT87_REG_FAN_4_LSB, IT87_REG_FAN_4_MSB,
+		{ IT87_REG_FAN_4_LIMIT_LSB, IT87_REG_FAN_4_LIMIT_MSB }, 3, 1, 1, 0, true, true },
+	{ "FAN5", SENSOR_FAN, FAN(4), IT87_REG_FAN_5_LSB, IT87_REG_FAN_5_MSB,
+		{ IT87_REG_FAN_5_LIMIT_LSB, IT87_REG_FAN_5_LIMIT_MSB }, 6, 1, 1, 0, true, true },
+};
+
+#undef VOLTAGE
+#undef TEMP
+#undef FAN
+
+
+static void
+build_sensor_table(it87_chip* chip, uint8 fanCount, bool fans16bit)
+{
+	memcpy(chip->sensors, kSensors, sizeof(chip->sensors));
+
+	for (int fan = 0; fan < 5; fan++) {
+		chip->sensors[IT87_CHANNEL_FAN1 + fan].is16bit = fans16bit;
+		chip->sensors[IT87_CHANNEL_FAN1 + fan].enabled = fan < fanCount;
+	}
+
+	chip->active_count = 0;
+	chip->available_channels = 0;
+	for (int channel = 0; channel < IT87_CHANNEL_COUNT; channel++) {
+		if (!chip->sensors[channel].enabled)
+			continue;
+		chip->active_sensors[chip->active_count++] = channel;
+		chip->available_channels |= IT87_CHANNEL_MASK(channel);
+	}
+}
+
+
+// Integer only: no FPU use in here.
+static inline int16
+RawToMilliVolts(uint8 raw, int32 adcResolution, const sensor_desc& sensor)
+{
+	return (int64)raw * adcResolution * sensor.scale_num / (sensor.scale_den * 1000LL)
+		+ sensor.scale_offset;
+}
+
+
+// Reads just the register(s) backing a single channel.
+static inline uint16
+it87_read_raw(it87_chip* chip, const sensor_desc& sensor)
+{
+	uint16 raw = ITESensorRead(chip, sensor.reg);
+	if (sensor.is16bit)
+		raw |= ITESensorRead(chip, sensor.reg_ext) << 8;
+	return raw;
+}
+
+
+// Converts register contents to mV, °C or RPM.
+static inline int16
+it87_convert(it87_chip* chip, const sensor_desc& sensor, uint16 raw)
+{
+	switch (sensor.kind) {
+		case SENSOR_VOLTAGE:
+			return RawToMilliVolts(raw, chip->info->adc_resolution, sensor);
+		case SENSOR_TEMP:
+			return TwosComplement(raw);
+		case SENSOR_FAN:
+			return sensor.is16bit ? Count16ToRPM(raw) : CountToRPM(raw);
+	}
+
+	return 0;
+}
+
+
+int16
+it87_read_sensor(it87_chip* chip, const sensor_desc& sensor)
+{
+	return it87_convert(chip, sensor, it87_read_raw(chip, sensor));
+}
+
+
+// Refreshes just the channels asked for, leaving the rest of "data" and "raw"
+// alone. Table driven: for all of them at once, chip->info->refresh does the same,
+// unrolled (see it87_refresh_chip<>() below).
+void
+it87_refresh_channels(it87_chip* chip, it87_sensors_data& data, it87_sensors_raw& raw,
+	uint32 channels)
+{
+	// Only the value registers are read here: the EC sits at the base address,
+	// so no MB PnP mode is needed, and monitoring is already running (see
+	// it87_config()).
+	for (int32 i = 0; i < chip->active_count; i++) {
+		int channel = chip->active_sensors[i];
+		const sensor_desc& sensor = chip->sensors[channel];
+		if ((channels & IT87_CHANNEL_MASK(channel)) == 0)
+			continue;
+
+		uint16 value = it87_read_raw(chip, sensor);
+		raw.registers[channel] = value & 0xff;
+		if (sensor.is16bit)
+			raw.fan_ext[channel - IT87_CHANNEL_FAN1] = value >> 8;
+
+		sensor_value(data, sensor) = it87_convert(chip, sensor, value);
+	}
+}
+
+
+// Port accesses it takes to refresh "channels": an index write plus a data
+// read per register.
+int32
+it87_port_budget(it87_chip* chip, uint32 channels)
+{
+	int32 budget = 0;
+	for (int32 i = 0; i < chip->active_count; i++) {
+		int channel = chip->active_sensors[i];
+		if ((channels & IT87_CHANNEL_MASK(channel)) != 0)
+			budget += chip->sensors[channel].is16bit ? 4 : 2;
+	}
+	return budget;
+}
+
+
+//-----------------------------------------------------------------------------
+//	#pragma mark - Chip traits
+
+// What sets the supported chips apart, as far as this driver cares. Each set
+// of traits gets its own, fully unrolled, refresh routine.
+
+// IT8705F / SiS 950, IT8712F: 8-bit tachometers.
+struct it8705_traits {
+	enum {
+		kFanCount		= 3,
+		k16BitFans		= false,
+		// 8-bit ADC with a range of 0 to 4096 mV. So... resolution is 16 mV.
+		// See "Table 4-1. Analog to Digital Table for Monitoring Voltage" on
+		// "IT8705F PG ec v03.pdf"
+		kAdcMicroVolts	= 16000,
+	};
+};
+
+// IT8718F, IT8720F, IT8726F.
+struct it8718_traits {
+	enum {
+		kFanCount		= 5,
+		k16BitFans		= true,
+		kAdcMicroVolts	= 16000,
+	};
+};
+
+// IT8721F, IT8728F, IT8628E: newer, 12 mV, ADC.
+struct it8721_traits {
+	enum {
+		kFanCount		= 5,
+		k16BitFans		= true,
+		kAdcMicroVolts	= 12000,
+	};
+};
+
+// IT8771E, IT8772E: only three tachometers.
+struct it8771_traits {
+	enum {
+		kFanCount		= 3,
+		k16BitFans		= true,
+		kAdcMicroVolts	= 12000,
+	};
+};
+
+// IT8625E, IT8655E: 10.9 mV ADC.
+struct it8625_traits {
+	enum {
+		kFanCount		= 5,
+		k16BitFans		= true,
+		kAdcMicroVolts	= 10900,
+	};
+};
+
+
+template<class Traits>
+static inline int16
+read_voltage(it87_chip* chip, int channel, it87_sensors_raw& raw)
+{
+	raw.registers[channel] = ITESensorRead(chip, kSensors[channel].reg);
+	return RawToMilliVolts(raw.registers[channel], Traits::kAdcMicroVolts,
+		chip->sensors[channel]);
+}
+
+
+static inline int16
+read_temp(it87_chip* chip, int channel, it87_sensors_raw& raw)
+{
+	raw.registers[channel] = ITESensorRead(chip, kSensors[channel].reg);
+	return TwosComplement(raw.registers[channel]);
+}
+
+
+template<class Traits, int kChannel>
+static inline int16
+read_fan(it87_chip* chip, it87_sensors_raw& raw)
+{
+	raw.registers[kChannel] = ITESensorRead(chip, kSensors[kChannel].reg);
+	if (Traits::k16BitFans) {
+		uint8& ext = raw.fan_ext[kChannel - IT87_CHANNEL_FAN1];
+		ext = ITESensorRead(chip, kSensors[kChannel].reg_ext);
+		return Count16ToRPM(raw.registers[kChannel] | ext << 8);
+	}
+	return CountToRPM(raw.registers[kChannel]);
+}
+
+
+template<class Traits>
+static void
+it87_refresh_chip(it87_chip* chip, it87_sensors_data& data, it87_sensors_raw& raw)
+{
+	data.voltages[0] = read_voltage<Traits>(chip, IT87_CHANNEL_VIN0, raw);
+	data.voltages[1] = read_voltage<Traits>(chip, IT87_CHANNEL_VIN1, raw);
+	data.voltages[2] = read_voltage<Traits>(chip, IT87_CHANNEL_VIN2, raw);
+	data.voltages[3] = read_voltage<Traits>(chip, IT87_CHANNEL_VIN3, raw);
+	data.voltages[4] = read_voltage<Traits>(chip, IT87_CHANNEL_VIN4, raw);
+	data.voltages[5] = read_voltage<Traits>(chip, IT87_CHANNEL_VIN5, raw);
+	data.voltages[6] = read_voltage<Traits>(chip, IT87_CHANNEL_VIN6, raw);
+	data.voltages[7] = read_voltage<Traits>(chip, IT87_CHANNEL_VIN7, raw);
+	data.voltages[8] = read_voltage<Traits>(chip, IT87_CHANNEL_VBAT, raw);
+
+	data.temps[0] = read_temp(chip, IT87_CHANNEL_TEMP0, raw);
+	data.temps[1] = read_temp(chip, IT87_CHANNEL_TEMP1, raw);
+	data.temps[2] = read_temp(chip, IT87_CHANNEL_TEMP2, raw);
+
+	data.fans[0] = read_fan<Traits, IT87_CHANNEL_FAN1>(chip, raw);
+	data.fans[1] = read_fan<Traits, IT87_CHANNEL_FAN2>(chip, raw);
+	data.fans[2] = read_fan<Traits, IT87_CHANNEL_FAN3>(chip, raw);
+	if (Traits::kFanCount > 3)
+		data.fans[3] = read_fan<Traits, IT87_CHANNEL_FAN4>(chip, raw);
+	if (Traits::kFanCount > 4)
+		data.fans[4] = read_fan<Traits, IT87_CHANNEL_FAN5>(chip, raw);
+}
+
+
+#define CHIP(id, traits) \
+	{ id, traits::kFanCount, traits::k16BitFans, traits::kAdcMicroVolts, \
+		it87_refresh_chip<traits> }
+
+static const chip_info kChips[] = {
+	CHIP(0x8625, it8625_traits),
+	CHIP(0x8628, it8721_traits),
+	CHIP(0x8655, it8625_traits),
+
+	CHIP(0x8705, it8705_traits),
+	CHIP(0x8712, it8705_traits),
+	CHIP(0x8718, it8718_traits),
+	CHIP(0x8720, it8718_traits),
+	CHIP(0x8721, it8721_traits),
+	CHIP(0x8726, it8718_traits),
+	CHIP(0x8728, it8721_traits),
+	CHIP(0x8771, it8771_traits),
+	CHIP(0x8772, it8771_traits),
+};
+
+#undef CHIP
+
+
+static const chip_info*
+find_chip(uint16 id)
+{
+	for (size_t i = 0; i < sizeof(kChips) / sizeof(kChips[0]); i++) {
+		if (kChips[i].id == id)
+			return &kChips[i];
+	}
+	return NULL;
+}
+
+
+// Output looks like "VIN0 :   1.280 V", "TEMP1:   22 °C" or "FAN1 : 1095 RPM".
+size_t
+it87_render_text(it87_chip* chip, const it87_sensors_data& data, char* buffer,
+	size_t size, uint32 channels)
+{
+	text_output out = { buffer, size, 0 };
+
+	for (int32 i = 0; i < chip->active_count; i++) {
+		if ((channels & IT87_CHANNEL_MASK(chip->active_sensors[i])) == 0)
+			continue;
+
+		const sensor_desc& sensor = chip->sensors[chip->active_sensors[i]];
+		int16 value = sensor_value(data, sensor);
+
+		OutString(out, sensor.name);
+		for (size_t pad = strlen(sensor.name); pad < 5; pad++)
+			OutChar(out, ' ');
+		OutString(out, ": ");
+
+		switch (sensor.kind) {
+			case SENSOR_VOLTAGE:
+				OutFloat(out, value, 1000, 3, 3);
+				OutString(out, " V\n");
+				break;
+			case SENSOR_TEMP:
+				OutInt(out, value, 4);
+				OutString(out, " °C\n");
+				break;
+			case SENSOR_FAN:
+				OutInt(out, value, 4);
+				OutString(out, " RPM\n");
+				break;
+		}
+	}
+
+	return out.length;
+}
+
+
+//-----------------------------------------------------------------------------
+//	#pragma mark - Limits and Alarms
+
+static inline int
+clamp(int value, int min, int max)
+{
+	return value < min ? min : (value > max ? max : value);
+}
+
+
+// Inverse of RawToMilliVolts().
+static uint8
+VoltageToRaw(it87_chip* chip, const sensor_desc& sensor, int mV)
+{
+	int64 divisor = (int64)chip->info->adc_resolution * sensor.scale_num;
+	int64 dividend = (mV - sensor.scale_offset) * sensor.scale_den * 1000LL;
+	if ((dividend < 0) != (divisor < 0))
+		return 0;
+	return clamp((dividend + divisor / 2) / divisor, 0, 255);
+}
+
+
+static uint16
+RPMToCount16(int rpm)
+{
+	if (rpm <= 0)
+		return 0xffff;	// never trips.
+	return clamp(675000 / rpm, 1, 0xfffe);
+}
+
+
+static uint8
+RPMToCount(int rpm)
+{
+	if (rpm <= 0)
+		return 255;
+	return clamp(1350000 / (rpm * 2), 1, 254);
+}
+
+
+// Callers serialize EC access. Returns the channels actually programmed.
+uint32
+it87_set_limits(it87_chip* chip, const it87_sensors_limits& limits)
+{
+	uint32 programmed = 0;
+
+	for (int32 i = 0; i < chip->active_count; i++) {
+		int channel = chip->active_sensors[i];
+		const sensor_desc& sensor = chip->sensors[channel];
+		if ((limits.channels & IT87_CHANNEL_MASK(channel)) == 0
+			|| sensor.alarm_bit == NO_ALARM)
+			continue;
+
+		int16 low = limits.low[channel];
+		int16 high = limits.high[channel];
+
+		switch (sensor.kind) {
+			case SENSOR_VOLTAGE:
+				ITESensorWrite(chip, sensor.limit_reg[0], VoltageToRaw(chip, sensor, high));
+				ITESensorWrite(chip, sensor.limit_reg[1], VoltageToRaw(chip, sensor, low));
+				break;
+			case SENSOR_TEMP:
+				ITESensorWrite(chip, sensor.limit_reg[0], (int8)clamp(high, -128, 127));
+				ITESensorWrite(chip, sensor.limit_reg[1], (int8)clamp(low, -128, 127));
+				break;
+			case SENSOR_FAN:
+				// Fans trip when the count goes above the limit (i.e. too slow).
+				if (sensor.is16bit) {
+					uint16 count = RPMToCount16(low);
+					ITESensorWrite(chip, sensor.limit_reg[0], count & 0xff);
+					ITESensorWrite(chip, sensor.limit_reg[1], count >> 8);
+				} else
+					ITESensorWrite(chip, sensor.limit_reg[0], RPMToCount(low));
+				break;
+		}
+
+		programmed |= IT87_CHANNEL_MASK(channel);
+	}
+
+	return programmed;
+}
+
+
+// Callers serialize EC access. Reading the interrupt status registers clears
+// them, so this returns what went out of limits since the last call.
+uint32
+it87_read_alarms(it87_chip* chip)
+{
+	uint32 status = ITESensorRead(chip, IT87_REG_INT_STATUS1)
+		| ITESensorRead(chip, IT87_REG_INT_STATUS2) << 8
+		| ITESensorRead(chip, IT87_REG_INT_STATUS3) << 16;
+
+	uint32 alarms = 0;
+	for (int32 i = 0; i < chip->active_count; i++) {
+		int channel = chip->active_sensors[i];
+		uint8 bit = chip->sensors[channel].alarm_bit;
+		if (bit != NO_ALARM && (status & (1 << bit)) != 0)
+			alarms |= IT87_CHANNEL_MASK(channel);
+	}
+
+	return alarms;
+}
+
+
+//-----------------------------------------------------------------------------
+//	#pragma mark - Tracing
+
+// Like the rest of the EC accesses, callers serialize these. Starting over
+// discards whatever was recorded.
+status_t
+it87_start_trace(it87_chip* chip)
+{
+	if (chip->trace == NULL) {
+		chip->trace = (it87_port_trace*)malloc(sizeof(it87_port_trace));
+		if (chip->trace == NULL)
+			return B_NO_MEMORY;
+	}
+
+	chip->trace->recorded = 0;
+	chip->trace->read = 0;
+	chip->trace->dropped = 0;
+	return B_OK;
+}
+
+
+void
+it87_stop_trace(it87_chip* chip)
+{
+	free(chip->trace);
+	chip->trace = NULL;
+}
+
+
+// Copies out (and forgets) up to "count" of the oldest port accesses recorded.
+uint32
+it87_read_trace(it87_chip* chip, it87_port_op* ops, uint32 count, uint32& dropped)
+{
+	it87_port_trace* trace = chip->trace;
+	dropped = 0;
+	if (trace == NULL)
+		return 0;
+
+	uint32 available = trace->recorded - trace->read;
+	if (count > available)
+		count = available;
+
+	for (uint32 i = 0; i < count; i++)
+		ops[i] = trace->ops[(trace->read + i) % IT87_TRACE_SIZE];
+
+	trace->read += count;
+	dropped = trace->dropped;
+	trace->dropped = 0;
+	return count;
+}
+
+
+//-----------------------------------------------------------------------------
+//	#pragma mark - Probing
+
+// Sets up "chip" for whatever is behind chip->config_port, if it's a supported
+// one.
+status_t
+it87_probe(it87_chip* chip)
+{
+	chip->chip_id = it87xx_detect(chip);
+	chip->info = find_chip(chip->chip_id);
+	if (chip->info == NULL)
+		return B_DEVICE_NOT_FOUND;
+
+	// Find out the proper ISA port address to talk to the EC.
+	chip->base_address = find_isa_port_address(chip);
+
+	if (chip->base_address == 0)
+		return ENOSYS;
+
+	uint8 vendor_id = ITESensorRead(chip, IT87_REG_ITE_VENDOR_ID);
+	uint8 core_id = ITESensorRead(chip, IT87_REG_CORE_ID);
+	uint8 rev_id = ITESensorRead(chip, IT87_CONFIG_SELECT_CHIP_VER) & 0xF;
+
+	INFO("ITE%4x found at address = 0x%04x. VENDOR_ID: 0x%02x - CORE_ID: 0x%02x - REV: 0x%02x\n",
+		chip->chip_id, chip->base_address, vendor_id, core_id, rev_id);
+
+	build_sensor_table(chip, chip->info->fan_count, chip->info->fans_16bit);
+	chip->refresh_port_budget = it87_port_budget(chip, chip->available_channels);
+
+	// Enable 16-bits tachometers on chips that have them.
+	if (chip->sensors[IT87_CHANNEL_FAN1].is16bit) {
+		uint8 counter_enable_reg = ITESensorRead(chip, IT87_REG_FAN_16BITS);
+		ITESensorWrite(chip, IT87_REG_FAN_16BITS, counter_enable_reg | 0x7); // set bits 2-0 bits to 1
+	}
+
+	return B_OK;
+}
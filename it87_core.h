@@ -0,0 +1,141 @@
+//
+// Copyright 2003-2006, 2022-2023, Oscar Lesta. All right reserved.
+// Distributed under the terms of the MIT License.
+//
+// Chip side of the it87 driver: Super I/O config space, EC registers, and the
+// conversions from/to them. Only needs the ISA module, dprintf() and atomics
+// from the kernel; sems, threads, areas and settings stay in it87.cpp.
+//
+
+#ifndef _IT87_CORE_H_
+#define _IT87_CORE_H_
+
+#include <ISA.h>
+#include <KernelExport.h>
+#include <SupportDefs.h>
+
+#include "it87.h"
+
+//-----------------------------------------------------------------------------
+
+#define TRACE_IT87
+#ifdef TRACE_IT87
+#	define TRACE(x...) dprintf("it87: " x)
+#else
+#	define TRACE(x...)
+#endif
+#define INFO(x...)	dprintf("it87: " x)
+#define ERROR(x...)	dprintf("it87: " x)
+
+
+extern isa_module_info* gISA;
+
+struct it87_chip;
+
+// Per chip capabilities, see kChips.
+struct chip_info {
+	uint16	id;
+	uint8	fan_count;
+	bool	fans_16bit;
+	int32	adc_resolution;		// µV
+
+	// Refreshes every channel at once, unrolled for this chip's traits (see
+	// it87_refresh_chip<>()).
+	void	(*refresh)(it87_chip* chip, it87_sensors_data& data,
+				it87_sensors_raw& raw);
+};
+
+#define NO_ALARM	0xFF
+
+// Also the channel group each one belongs to.
+enum sensor_kind {
+	SENSOR_VOLTAGE	= IT87_GROUP_VOLTAGES,
+	SENSOR_TEMP		= IT87_GROUP_TEMPS,
+	SENSOR_FAN		= IT87_GROUP_FANS,
+};
+
+// Everything needed to read, convert, print and set limits for one channel.
+struct sensor_desc {
+	const char*	name;
+	uint8		kind;
+	uint8		offset;			// of the value in it87_sensors_data.
+	uint8		reg;			// value register (LSB for 16-bit tachometers).
+	uint8		reg_ext;		// MSB register for 16-bit tachometers.
+	uint8		limit_reg[2];	// high/low limits. Fans: low limit LSB/MSB.
+	uint8		alarm_bit;		// in INT_STATUS3:INT_STATUS2:INT_STATUS1.
+	int16		scale_num;		// voltages only: input divider, as
+	int16		scale_den;		// numerator / denominator, plus an
+	int16		scale_offset;	// offset in mV (for negative rails).
+	bool		is16bit;
+	bool		enabled;
+};
+
+// The value of "sensor" in "data".
+static inline int16&
+sensor_value(it87_sensors_data& data, const sensor_desc& sensor)
+{
+	return *(int16*)((uint8*)&data + sensor.offset);
+}
+
+
+static inline int16
+sensor_value(const it87_sensors_data& data, const sensor_desc& sensor)
+{
+	return *(const int16*)((const uint8*)&data + sensor.offset);
+}
+
+
+// Port accesses get recorded in here while tracing, see it87_start_trace().
+struct it87_port_trace {
+	uint32			recorded;	// since tracing started.
+	uint32			read;		// by it87_read_trace().
+	uint32			dropped;	// overwritten before being read.
+	it87_port_op	ops[IT87_TRACE_SIZE];
+};
+
+// One Super I/O chip, as far as talking to it goes.
+struct it87_chip {
+	uint16				config_port;	// 0x2E or 0x4E.
+	uint16				chip_id;
+	const chip_info*	info;
+	uint16				base_address;	// of the EC (usually 0x290).
+
+	// Channels actually present on this chip, in channel order.
+	sensor_desc			sensors[IT87_CHANNEL_COUNT];
+	uint8				active_sensors[IT87_CHANNEL_COUNT];
+	int32				active_count;
+	uint32				available_channels;
+
+	// Port accesses a full refresh takes, see it87_port_budget(). Anything
+	// above that means a bug, or a misbehaving chip.
+	int32				refresh_port_budget;
+
+	// Port and register accesses get accounted for in here. The rest is up to
+	// the driver.
+	it87_sensors_stats	stats;
+
+	it87_port_trace*	trace;			// NULL unless tracing.
+};
+
+
+uint16		it87xx_detect(it87_chip* chip);
+status_t	it87_probe(it87_chip* chip);
+void		it87_config(it87_chip* chip, bool enable);
+
+void		it87_refresh_channels(it87_chip* chip, it87_sensors_data& data,
+				it87_sensors_raw& raw, uint32 channels);
+int32		it87_port_budget(it87_chip* chip, uint32 channels);
+
+int16		it87_read_sensor(it87_chip* chip, const sensor_desc& sensor);
+size_t		it87_render_text(it87_chip* chip, const it87_sensors_data& data,
+				char* buffer, size_t size, uint32 channels = ~(uint32)0);
+
+status_t	it87_start_trace(it87_chip* chip);
+void		it87_stop_trace(it87_chip* chip);
+uint32		it87_read_trace(it87_chip* chip, it87_port_op* ops, uint32 count,
+				uint32& dropped);
+
+uint32		it87_set_limits(it87_chip* chip, const it87_sensors_limits& limits);
+uint32		it87_read_alarms(it87_chip* chip);
+
+#endif	// _IT87_CORE_H_
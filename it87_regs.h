@@ -15,6 +15,14 @@ enum it87_const {
 	IT87_WAIT	= 1600,	// wait this many µs for the device to become ready.
 	IT87_BUSY	= 0x80,
 	IT87_FANDIV	= 0x09,	// Div by two = 00 001-001
+
+	IT87_SAMPLE_PERIOD		= 1000,	// ms between samples (default).
+	IT87_MIN_SAMPLE_PERIOD	= 100,	// ms. Don't let settings hammer the LPC bus.
+	IT87_MAX_SAMPLE_PERIOD	= 5000,	// ms. Adaptive sampling backs off up to this.
+	IT87_IDLE_TIMEOUT		= 60,	// s without requests before sampling stops.
+	IT87_CONVERSION_TIME	= 100,	// ms for the ADC to go over every input once
+									// monitoring starts. Generous, the datasheets
+									// don't say.
 };
 
 
@@ -169,8 +177,12 @@ enum it87_ec_registers {
 	// IT8718F from now on:
 	IT87_REG_FAN_4_LSB	= 0x80,
 	IT87_REG_FAN_4_MSB	= 0x81,
-	IT87_REG_FAN_5_LSB	= 0x82,	// IT87_REG_FAN_4_LIMIT_LSB ?
-	IT87_REG_FAN_5_MSB	= 0x83,	// IT87_REG_FAN_4_LIMIT_MSB ?
+	IT87_REG_FAN_5_LSB	= 0x82,
+	IT87_REG_FAN_5_MSB	= 0x83,
+	IT87_REG_FAN_4_LIMIT_LSB	= 0x84,
+	IT87_REG_FAN_4_LIMIT_MSB	= 0x85,
+	IT87_REG_FAN_5_LIMIT_LSB	= 0x86,
+	IT87_REG_FAN_5_LIMIT_MSB	= 0x87,
 
 	IT87_REG_EXTERNAL_TEMP_HOST_STATUS		= 0x88,
 	IT87_REG_EXTERNAL_TEMP_HOST_TARGET		= 0x89,